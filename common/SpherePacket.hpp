@@ -0,0 +1,138 @@
+#pragma once
+
+// Shared by hw5 and hw7. It takes any vector type with x, y and z members, so it doesn't
+// depend on either homework's Vector.hpp.
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SPHERE_PACKET_AVX 1
+#endif
+
+// Up to eight spheres stored structure-of-arrays so one ray can be tested against all of
+// them with a single 8-wide AVX instruction stream. Unused lanes repeat the last sphere,
+// which can only report a hit the real lane reports as well.
+struct alignas(32) SpherePacket
+{
+    static constexpr int Width = 8;
+
+    float cx[Width], cy[Width], cz[Width];
+    float radius2[Width];
+    uint32_t id[Width];
+};
+
+namespace sphere_packet_detail
+{
+// Closest hit over the lanes of the packet with t in (tMin, tMax). The quadratic is
+// solved through the squared distance between the sphere center and the ray line,
+// which stays accurate for spheres that are small compared to their distance.
+inline bool intersectScalar(const SpherePacket& p, const float orig[3], const float dir[3], float tMin,
+                            float tMax, float& tHit, int& lane)
+{
+    float a = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+    float invA = 1 / a;
+    bool hit = false;
+    for (int i = 0; i < SpherePacket::Width; ++i)
+    {
+        float Lx = orig[0] - p.cx[i], Ly = orig[1] - p.cy[i], Lz = orig[2] - p.cz[i];
+        float hb = Lx * dir[0] + Ly * dir[1] + Lz * dir[2];
+        float k = hb * invA;
+        float lx = Lx - dir[0] * k, ly = Ly - dir[1] * k, lz = Lz - dir[2] * k;
+        float disc = p.radius2[i] - (lx * lx + ly * ly + lz * lz);
+        if (disc < 0)
+            continue;
+        float sq = std::sqrt(disc * a);
+        float t0 = (-hb - sq) * invA;
+        float t1 = (-hb + sq) * invA;
+        float t = t0 > tMin ? t0 : t1;
+        if (t > tMin && t < tMax)
+        {
+            tMax = t;
+            tHit = t;
+            lane = i;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+#ifdef SPHERE_PACKET_AVX
+__attribute__((target("avx"))) inline bool intersectAVX(const SpherePacket& p, const float orig[3],
+                                                          const float dir[3], float tMin, float tMax,
+                                                          float& tHit, int& lane)
+{
+    float a = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+    const __m256 va = _mm256_set1_ps(a);
+    const __m256 invA = _mm256_set1_ps(1 / a);
+    const __m256 dx = _mm256_set1_ps(dir[0]), dy = _mm256_set1_ps(dir[1]), dz = _mm256_set1_ps(dir[2]);
+
+    __m256 Lx = _mm256_sub_ps(_mm256_set1_ps(orig[0]), _mm256_load_ps(p.cx));
+    __m256 Ly = _mm256_sub_ps(_mm256_set1_ps(orig[1]), _mm256_load_ps(p.cy));
+    __m256 Lz = _mm256_sub_ps(_mm256_set1_ps(orig[2]), _mm256_load_ps(p.cz));
+    __m256 hb = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Lx, dx), _mm256_mul_ps(Ly, dy)), _mm256_mul_ps(Lz, dz));
+
+    __m256 k = _mm256_mul_ps(hb, invA);
+    __m256 lx = _mm256_sub_ps(Lx, _mm256_mul_ps(k, dx));
+    __m256 ly = _mm256_sub_ps(Ly, _mm256_mul_ps(k, dy));
+    __m256 lz = _mm256_sub_ps(Lz, _mm256_mul_ps(k, dz));
+    __m256 l2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz));
+    __m256 disc = _mm256_sub_ps(_mm256_load_ps(p.radius2), l2);
+    __m256 valid = _mm256_cmp_ps(disc, _mm256_setzero_ps(), _CMP_GE_OQ);
+
+    __m256 sq = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_max_ps(disc, _mm256_setzero_ps()), va));
+    __m256 nhb = _mm256_sub_ps(_mm256_setzero_ps(), hb);
+    __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(nhb, sq), invA);
+    __m256 t1 = _mm256_mul_ps(_mm256_add_ps(nhb, sq), invA);
+    __m256 vtMin = _mm256_set1_ps(tMin);
+    __m256 t = _mm256_blendv_ps(t1, t0, _mm256_cmp_ps(t0, vtMin, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, vtMin, _CMP_GT_OQ));
+    valid = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ));
+
+    int mask = _mm256_movemask_ps(valid);
+    if (mask == 0)
+        return false;
+
+    alignas(32) float ts[SpherePacket::Width];
+    _mm256_store_ps(ts, t);
+    for (int i = 0; i < SpherePacket::Width; ++i)
+    {
+        if (((mask >> i) & 1) && ts[i] < tMax)
+        {
+            tMax = ts[i];
+            lane = i;
+        }
+    }
+    tHit = tMax;
+    return true;
+}
+
+inline bool cpuHasAVX()
+{
+    static const bool hasAVX = __builtin_cpu_supports("avx");
+    return hasAVX;
+}
+#endif
+} // namespace sphere_packet_detail
+
+// Closest intersection of the ray with the spheres of the packet in (tMin, tMax). On a hit
+// tHit is the ray parameter and index the id of the sphere that was hit.
+template <typename Vec>
+inline bool intersectSpherePacket(const SpherePacket& p, const Vec& orig, const Vec& dir, float tMin, float tMax,
+                                  float& tHit, uint32_t& index)
+{
+    const float o[3] = {orig.x, orig.y, orig.z}, d[3] = {dir.x, dir.y, dir.z};
+    int lane = 0;
+    bool hit;
+#ifdef SPHERE_PACKET_AVX
+    if (sphere_packet_detail::cpuHasAVX())
+        hit = sphere_packet_detail::intersectAVX(p, o, d, tMin, tMax, tHit, lane);
+    else
+#endif
+        hit = sphere_packet_detail::intersectScalar(p, o, d, tMin, tMax, tHit, lane);
+    if (hit)
+        index = p.id[lane];
+    return hit;
+}
@@ -111,14 +111,16 @@ int main(int argc, const char** argv)
         r.set_projection(get_projection_matrix(45, 1, 0.1, 50));
 
         r.draw(pos_id, ind_id, rst::Primitive::Triangle);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
+        cv::Mat image(700, 700, CV_8UC3);
+        r.resolve(image.data, rst::PixelFormat::BGR8, image.step);
 
         cv::imwrite(filename, image);
 
         return 0;
     }
 
+    // the frames are resolved straight into the image OpenCV shows
+    cv::Mat image(700, 700, CV_8UC3);
     while (key != 27) {
         r.clear(rst::Buffers::Color | rst::Buffers::Depth);
 
@@ -128,8 +130,7 @@ int main(int argc, const char** argv)
 
         r.draw(pos_id, ind_id, rst::Primitive::Triangle);
 
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
+        r.resolve(image.data, rst::PixelFormat::BGR8, image.step);
         cv::imshow("image", image);
         key = cv::waitKey(10);
 
@@ -235,3 +235,48 @@ void rst::rasterizer::set_pixel(const Eigen::Vector3f& point, const Eigen::Vecto
     frame_buf[ind] = color;
 }
 
+// cv::saturate_cast<uchar>: rounds to nearest even, then clamps
+static uint8_t to_unorm8(float v)
+{
+    return uint8_t(std::min(std::max(lrintf(v), 0L), 255L));
+}
+
+void rst::rasterizer::resolve(void* dst, PixelFormat format, size_t stride) const
+{
+    if (format == PixelFormat::RGB32F_Planar)
+    {
+        if (stride == 0)
+            stride = width * sizeof(float);
+        for (int y = 0; y < height; y++)
+        {
+            float* planes[3];
+            for (int c = 0; c < 3; c++)
+                planes[c] = (float*)((char*)dst + (c * height + y) * stride);
+            const Eigen::Vector3f* src = &frame_buf[y * width];
+            for (int x = 0; x < width; x++)
+                for (int c = 0; c < 3; c++)
+                    planes[c][x] = src[x][c];
+        }
+        return;
+    }
+
+    int channels = format == PixelFormat::RGBA8 || format == PixelFormat::BGRA8 ? 4 : 3;
+    // the channel of frame_buf that goes first in dst
+    int first = format == PixelFormat::BGR8 || format == PixelFormat::BGRA8 ? 2 : 0;
+    if (stride == 0)
+        stride = width * channels;
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t* out = (uint8_t*)dst + y * stride;
+        const Eigen::Vector3f* src = &frame_buf[y * width];
+        for (int x = 0; x < width; x++, out += channels)
+        {
+            out[0] = to_unorm8(src[x][first]);
+            out[1] = to_unorm8(src[x][1]);
+            out[2] = to_unorm8(src[x][2 - first]);
+            if (channels == 4)
+                out[3] = 255;
+        }
+    }
+}
+
@@ -32,6 +32,18 @@ enum class Primitive
     Triangle
 };
 
+// Layouts resolve() writes the color buffer in. The 8 bit ones round every channel and clamp
+// it to [0, 255], as cv::Mat::convertTo does; BGR8 is what OpenCV shows and writes, and the
+// alpha of RGBA8/BGRA8 is 255. RGB32F_Planar is three float planes: red, green, then blue.
+enum class PixelFormat
+{
+    RGB8,
+    BGR8,
+    RGBA8,
+    BGRA8,
+    RGB32F_Planar
+};
+
 /*
  * For the curious : The draw function takes two buffer id's as its arguments.
  * These two structs make sure that if you mix up with their orders, the
@@ -65,6 +77,10 @@ class rasterizer
     void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, Primitive type);
 
     std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
+    // Converts the color buffer, top row first, into dst in one pass, so a display or an encoder
+    // can take it without an intermediate image. stride is the bytes from a row of dst to the
+    // next (a plane of the planar format is height rows); 0 means tightly packed.
+    void resolve(void* dst, PixelFormat format, size_t stride = 0) const;
 
   private:
     void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
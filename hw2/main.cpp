@@ -81,6 +81,9 @@ int main(int argc, const char** argv)
     rst::rasterizer r(700, 700);
 
     Eigen::Vector3f eye_pos = {0,0,5};
+    // the projection's near and far planes, which the rasterizer clips against
+    float z_near = 0.1, z_far = 50;
+    r.set_clip_planes(z_near, z_far);
 
 
     std::vector<Eigen::Vector3f> pos
@@ -122,31 +125,30 @@ int main(int argc, const char** argv)
 
         r.set_model(get_model_matrix(angle));
         r.set_view(get_view_matrix(eye_pos));
-        r.set_projection(get_projection_matrix(45, 1, 0.1, 50));
+        r.set_projection(get_projection_matrix(45, 1, z_near, z_far));
 
         r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+        cv::Mat image(700, 700, CV_8UC3);
+        r.resolve(image.data, rst::PixelFormat::BGR8, image.step);
 
         cv::imwrite(filename, image);
 
         return 0;
     }
 
+    // the frames are resolved straight into the image OpenCV shows
+    cv::Mat image(700, 700, CV_8UC3);
     while(key != 27)
     {
         r.clear(rst::Buffers::Color | rst::Buffers::Depth);
 
         r.set_model(get_model_matrix(angle));
         r.set_view(get_view_matrix(eye_pos));
-        r.set_projection(get_projection_matrix(45, 1, 0.1, 50));
+        r.set_projection(get_projection_matrix(45, 1, z_near, z_far));
 
         r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
 
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+        r.resolve(image.data, rst::PixelFormat::BGR8, image.step);
         cv::imshow("image", image);
         key = cv::waitKey(10);
 
@@ -40,28 +40,75 @@ auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
 }
 
 
-static bool insideTriangle(float x, float y, const Vector3f* _v)
-{   
-    // TODO : Implement this function to check if the point (x, y) is inside the triangle represented by _v[0], _v[1], _v[2]
-    bool res[3];
-    Vector3f side;
-    Vector3f p(x, y, 1.0f);
-    Vector3f vecP;
-    for (int i = 0; i < 3; i++) {
-        side = _v[i] - _v[(i + 1) % 3];
-        // std::cout << side;
-        vecP = p - _v[i];
-        res[i] = (vecP[0] * side[1] - vecP[1] * side[0]) < 0;
+// Edge functions of a screen-space triangle, set up once per triangle. e_i(x, y) = a_i x + b_i y + c_i
+// is the signed area spanned by the edge opposite vertex i and the point, divided by the signed
+// area of the triangle, so the three values at a pixel are its barycentric coordinates. Moving one
+// pixel in x adds a_i, so a row costs one evaluation at its start and three additions per pixel.
+struct EdgeFunctions
+{
+    float a[3], b[3], c[3];
+    // pixels exactly on an edge count for counter-clockwise triangles only
+    bool inclusive;
+
+    // false for a triangle with no area, which covers no pixel
+    bool setup(const Vector3f* v)
+    {
+        float area = (v[1].x() - v[0].x()) * (v[2].y() - v[0].y()) - (v[2].x() - v[0].x()) * (v[1].y() - v[0].y());
+        if (area == 0)
+            return false;
+        float inv_area = 1.0f / area;
+        for (int i = 0; i < 3; i++) {
+            const Vector3f& p = v[(i + 1) % 3];
+            const Vector3f& q = v[(i + 2) % 3];
+            // (q - p) x ((x, y) - p)
+            a[i] = (p.y() - q.y()) * inv_area;
+            b[i] = (q.x() - p.x()) * inv_area;
+            c[i] = (p.x() * q.y() - q.x() * p.y()) * inv_area;
+        }
+        inclusive = area > 0;
+        return true;
     }
-    return (res[0] == res[1] && res[1] == res[2]);
-}
 
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector3f* v)
+    void at(float x, float y, float* e) const
+    {
+        for (int i = 0; i < 3; i++)
+            e[i] = a[i] * x + b[i] * y + c[i];
+    }
+
+    bool inside(const float* e) const
+    {
+        return inclusive ? e[0] >= 0 && e[1] >= 0 && e[2] >= 0 : e[0] > 0 && e[1] > 0 && e[2] > 0;
+    }
+};
+
+// A vertex out of the vertex stage, or made by clipping: its clip space position and the
+// attributes interpolated across triangles, all of which vary linearly in clip space.
+struct ClipVertex
+{
+    Eigen::Vector4f pos;
+    Eigen::Vector3f view_pos;
+    Eigen::Vector3f color;
+};
+
+// One Sutherland-Hodgman step: the part of the polygon in[0..count) where distance() is not
+// negative goes to out, keeping the winding. Returns its vertex count, at most count + 1.
+template <typename Distance>
+static int clip_polygon(const ClipVertex* in, int count, ClipVertex* out, Distance&& distance)
 {
-    float c1 = (x*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*y + v[1].x()*v[2].y() - v[2].x()*v[1].y()) / (v[0].x()*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*v[0].y() + v[1].x()*v[2].y() - v[2].x()*v[1].y());
-    float c2 = (x*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*y + v[2].x()*v[0].y() - v[0].x()*v[2].y()) / (v[1].x()*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*v[1].y() + v[2].x()*v[0].y() - v[0].x()*v[2].y());
-    float c3 = (x*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*y + v[0].x()*v[1].y() - v[1].x()*v[0].y()) / (v[2].x()*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*v[2].y() + v[0].x()*v[1].y() - v[1].x()*v[0].y());
-    return {c1,c2,c3};
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        const ClipVertex& a = in[i];
+        const ClipVertex& b = in[(i + 1) % count];
+        float da = distance(a), db = distance(b);
+        if (da >= 0)
+            out[n++] = a;
+        if ((da >= 0) != (db >= 0)) {
+            float s = da / (da - db);
+            out[n++] = {a.pos + s * (b.pos - a.pos), a.view_pos + s * (b.view_pos - a.view_pos),
+                        a.color + s * (b.color - a.color)};
+        }
+    }
+    return n;
 }
 
 void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type)
@@ -70,48 +117,60 @@ void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf
     auto& ind = ind_buf[ind_buffer.ind_id];
     auto& col = col_buf[col_buffer.col_id];
 
-    float f1 = (50 - 0.1) / 2.0;
-    float f2 = (50 + 0.1) / 2.0;
+    float f1 = (z_far - z_near) / 2.0;
+    float f2 = (z_far + z_near) / 2.0;
 
     Eigen::Matrix4f mvp = projection * view * model;
+    Eigen::Matrix4f mv = view * model;
     for (auto& i : ind)
     {
-        Triangle t;
-        Eigen::Vector4f v[] = {
-                mvp * to_vec4(buf[i[0]], 1.0f),
-                mvp * to_vec4(buf[i[1]], 1.0f),
-                mvp * to_vec4(buf[i[2]], 1.0f)
-        };
+        // up to one extra vertex per clipping plane
+        ClipVertex polygon[5], clipped[5];
+        for (int k = 0; k < 3; k++)
+            polygon[k] = {mvp * to_vec4(buf[i[k]], 1.0f), (mv * to_vec4(buf[i[k]], 1.0f)).head<3>(), col[i[k]]};
+
+        // Near and far clipping, before the homogeneous division, so no vertex has w close to 0 or
+        // behind the eye. The planes are given by view space depth, which is linear in clip space.
+        int count = 3;
+        auto near_plane = [&](const ClipVertex& v) { return -v.view_pos.z() - z_near; };
+        auto far_plane = [&](const ClipVertex& v) { return v.view_pos.z() + z_far; };
+        bool inside = true;
+        for (int k = 0; k < 3; k++)
+            inside &= near_plane(polygon[k]) >= 0 && far_plane(polygon[k]) >= 0;
+        if (!inside) {
+            count = clip_polygon(polygon, count, clipped, near_plane);
+            count = clip_polygon(clipped, count, polygon, far_plane);
+        }
+
         //Homogeneous division
-        for (auto& vec : v) {
+        for (int k = 0; k < count; k++) {
+            Eigen::Vector4f& vec = polygon[k].pos;
             float temp = vec.w();
             vec /= vec.w();
             vec.w() = temp;
         }
         //Viewport transformation
-        for (auto & vert : v)
+        for (int k = 0; k < count; k++)
         {
+            Eigen::Vector4f& vert = polygon[k].pos;
             vert.x() = 0.5*width*(vert.x()+1.0);
             vert.y() = 0.5*height*(vert.y()+1.0);
             vert.z() = vert.z() * f1 + f2;
         }
 
-        for (int i = 0; i < 3; ++i)
+        // the clipped polygon is convex: a fan around its first vertex
+        for (int k = 1; k + 1 < count; k++)
         {
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
-            t.setVertex(i, v[i].head<3>());
-        }
-
-        auto col_x = col[i[0]];
-        auto col_y = col[i[1]];
-        auto col_z = col[i[2]];
-
-        t.setColor(0, col_x[0], col_x[1], col_x[2]);
-        t.setColor(1, col_y[0], col_y[1], col_y[2]);
-        t.setColor(2, col_z[0], col_z[1], col_z[2]);
+            const ClipVertex* corner[3] = {&polygon[0], &polygon[k], &polygon[k + 1]};
+            Triangle t;
+            for (int j = 0; j < 3; ++j)
+            {
+                t.setVertex(j, corner[j]->pos.head<3>());
+                t.setColor(j, corner[j]->color[0], corner[j]->color[1], corner[j]->color[2]);
+            }
 
-        rasterize_triangle(t);
+            rasterize_triangle(t);
+        }
     }
 }
 
@@ -139,28 +198,31 @@ void rst::rasterizer::rasterize_triangle(const Triangle& t) {
             max_y = v[i][1];
         }
     }
-
-    Vector3f tri_v[3];
-    tri_v[0] << v[0].x(), v[0].y(), 1;
-    tri_v[1] << v[1].x(), v[1].y(), 1;
-    tri_v[2] << v[2].x(), v[2].y(), 1;
+    // only pixels on the screen
+    min_x = std::max(min_x, 0);
+    min_y = std::max(min_y, 0);
+    max_x = std::min(max_x, width - 1);
+    max_y = std::min(max_y, height - 1);
+
+    EdgeFunctions edges;
+    if (!edges.setup(t.v))
+        return;
+    float inv_w[3] = {1.0f / v[0].w(), 1.0f / v[1].w(), 1.0f / v[2].w()};
+    float z_over_w[3] = {v[0].z() * inv_w[0], v[1].z() * inv_w[1], v[2].z() * inv_w[2]};
 
     for (int y = min_y; y <= max_y; y++) {
-        for (int x = min_x; x <= max_x; x++) {
-            if (insideTriangle(x, y, tri_v)) {
-                auto[alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-                float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-                float z_interpolated = alpha * v[0].w() / v[0].w() + beta * v[1].w() / v[1].w() + gamma * v[2].w() / v[2].w();
-                // if (abs(z_interpolated) - 1 > 1e-8) {
-                //     std::cout << "error\n";
-                // }
-                z_interpolated *= w_reciprocal;
-
-                int index = get_index(x, y);
-                if (depth_buf[index] > z_interpolated) {
-                    depth_buf[index] = z_interpolated;
-                    set_pixel(Vector3f(x, y, 1), t.getColor());
-                }
+        float e[3];
+        edges.at(min_x, y, e);
+        for (int x = min_x; x <= max_x; x++, e[0] += edges.a[0], e[1] += edges.a[1], e[2] += edges.a[2]) {
+            if (!edges.inside(e))
+                continue;
+            float w_reciprocal = 1.0f / (e[0] * inv_w[0] + e[1] * inv_w[1] + e[2] * inv_w[2]);
+            float z_interpolated = (e[0] * z_over_w[0] + e[1] * z_over_w[1] + e[2] * z_over_w[2]) * w_reciprocal;
+
+            int index = get_index(x, y);
+            if (depth_buf[index] > z_interpolated) {
+                depth_buf[index] = z_interpolated;
+                set_pixel(Vector3f(x, y, 1), t.getColor());
             }
         }
     }
@@ -257,4 +319,49 @@ void rst::rasterizer::set_pixel(const Eigen::Vector3f& point, const Eigen::Vecto
 
 }
 
+// cv::saturate_cast<uchar>: rounds to nearest even, then clamps
+static uint8_t to_unorm8(float v)
+{
+    return uint8_t(std::min(std::max(lrintf(v), 0L), 255L));
+}
+
+void rst::rasterizer::resolve(void* dst, PixelFormat format, size_t stride) const
+{
+    if (format == PixelFormat::RGB32F_Planar)
+    {
+        if (stride == 0)
+            stride = width * sizeof(float);
+        for (int y = 0; y < height; y++)
+        {
+            float* planes[3];
+            for (int c = 0; c < 3; c++)
+                planes[c] = (float*)((char*)dst + (c * height + y) * stride);
+            const Eigen::Vector3f* src = &frame_buf[y * width];
+            for (int x = 0; x < width; x++)
+                for (int c = 0; c < 3; c++)
+                    planes[c][x] = src[x][c];
+        }
+        return;
+    }
+
+    int channels = format == PixelFormat::RGBA8 || format == PixelFormat::BGRA8 ? 4 : 3;
+    // the channel of frame_buf that goes first in dst
+    int first = format == PixelFormat::BGR8 || format == PixelFormat::BGRA8 ? 2 : 0;
+    if (stride == 0)
+        stride = width * channels;
+    for (int y = 0; y < height; y++)
+    {
+        uint8_t* out = (uint8_t*)dst + y * stride;
+        const Eigen::Vector3f* src = &frame_buf[y * width];
+        for (int x = 0; x < width; x++, out += channels)
+        {
+            out[0] = to_unorm8(src[x][first]);
+            out[1] = to_unorm8(src[x][1]);
+            out[2] = to_unorm8(src[x][2 - first]);
+            if (channels == 4)
+                out[3] = 255;
+        }
+    }
+}
+
 // clang-format on
\ No newline at end of file
@@ -34,6 +34,18 @@ namespace rst
         Triangle
     };
 
+    // Layouts resolve() writes the color buffer in. The 8 bit ones round every channel and clamp
+    // it to [0, 255], as cv::Mat::convertTo does; BGR8 is what OpenCV shows and writes, and the
+    // alpha of RGBA8/BGRA8 is 255. RGB32F_Planar is three float planes: red, green, then blue.
+    enum class PixelFormat
+    {
+        RGB8,
+        BGR8,
+        RGBA8,
+        BGRA8,
+        RGB32F_Planar
+    };
+
     /*
      * For the curious : The draw function takes two buffer id's as its arguments. These two structs
      * make sure that if you mix up with their orders, the compiler won't compile it.
@@ -65,6 +77,13 @@ namespace rst
         void set_model(const Eigen::Matrix4f& m);
         void set_view(const Eigen::Matrix4f& v);
         void set_projection(const Eigen::Matrix4f& p);
+        // The near and far planes, as distances in front of the eye: triangles are clipped against
+        // them and their depths mapped to the depth range. They must be those of the projection.
+        void set_clip_planes(float near_plane, float far_plane)
+        {
+            z_near = near_plane;
+            z_far = far_plane;
+        }
 
         void set_pixel(const Eigen::Vector3f& point, const Eigen::Vector3f& color);
 
@@ -73,6 +92,10 @@ namespace rst
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
 
         std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
+        // Converts the color buffer, top row first, into dst in one pass, so a display or an encoder
+        // can take it without an intermediate image. stride is the bytes from a row of dst to the
+        // next (a plane of the planar format is height rows); 0 means tightly packed.
+        void resolve(void* dst, PixelFormat format, size_t stride = 0) const;
 
     private:
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
@@ -98,6 +121,9 @@ namespace rst
         std::vector<float> depth_buf;
         int get_index(int x, int y);
 
+        // set by set_clip_planes()
+        float z_near = 0.1f, z_far = 50;
+
         int width, height;
 
         int next_id = 0;
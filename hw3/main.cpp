@@ -1,6 +1,8 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include <algorithm>
+#include <array>
+#include <map>
 
 #include "global.hpp"
 #include "rasterizer.hpp"
@@ -92,13 +94,16 @@ Eigen::Vector3f vertex_shader(const vertex_shader_payload& payload)
     return payload.position;
 }
 
-Eigen::Vector3f normal_fragment_shader(const fragment_shader_payload& payload)
+struct normal_fragment_shader
 {
-    Eigen::Vector3f return_color = (payload.normal.head<3>().normalized() + Eigen::Vector3f(1.0f, 1.0f, 1.0f)) / 2.f;
-    Eigen::Vector3f result;
-    result << return_color.x() * 255, return_color.y() * 255, return_color.z() * 255;
-    return result;
-}
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const
+    {
+        Eigen::Vector3f return_color = (payload.normal.head<3>().normalized() + Eigen::Vector3f(1.0f, 1.0f, 1.0f)) / 2.f;
+        Eigen::Vector3f result;
+        result << return_color.x() * 255, return_color.y() * 255, return_color.z() * 255;
+        return result;
+    }
+};
 
 static Eigen::Vector3f reflect(const Eigen::Vector3f& vec, const Eigen::Vector3f& axis)
 {
@@ -112,276 +117,254 @@ struct light
     Eigen::Vector3f intensity;
 };
 
-Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload& payload)
+// The uniform block of the lit shaders: scene and material constants that are the same for every
+// fragment, set up once when the shader is constructed for a draw rather than per invocation.
+struct lit_shader
 {
-    Eigen::Vector3f return_color = {0, 0, 0};
-    if (payload.texture)
-    {
-        // TODO: Get the texture value at the texture coordinates of the current fragment
-        return_color = payload.texture->getColorBilinear(payload.tex_coords.x(), payload.tex_coords.y());
-        // return_color = payload.texture->getColor(payload.tex_coords.x(), payload.tex_coords.y());
-    }
-    Eigen::Vector3f texture_color;
-    texture_color << return_color.x(), return_color.y(), return_color.z();
-
     Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = texture_color / 255.f;
     Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
 
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
+    std::array<light, 2> lights = {light{{20, 20, 20}, {500, 500, 500}}, light{{-20, 20, 0}, {500, 500, 500}}};
     Eigen::Vector3f amb_light_intensity{10, 10, 10};
     Eigen::Vector3f eye_pos{0, 0, 10};
 
     float p = 150;
+    float kh = 0.2, kn = 0.1;
+};
 
-    Eigen::Vector3f color = texture_color;
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
-
-    Eigen::Vector3f result_color = {0, 0, 0};
-
-    for (auto& light : lights)
-    {
-        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-        // components are. Then, accumulate that result on the *result_color* object.
-        Vector3f l = light.position - payload.view_pos;
-        auto light_arr = light.intensity / pow(l.norm(), 2);
-        l.normalize();
-        Vector3f v = (eye_pos - payload.view_pos).normalized();
-        Vector3f diffuse_light = light_arr * std::max(l.dot(payload.normal), 0.0f);
-        diffuse_light = {
-            diffuse_light[0] * kd[0],
-            diffuse_light[1] * kd[1],
-            diffuse_light[2] * kd[2]
-        };
-        result_color += diffuse_light;
-        Vector3f h = (v + l).normalized();
-        Vector3f specular_light = light_arr * pow(std::max(h.dot(payload.normal), 0.0f), p);
-        specular_light = {
-            ks[0] * specular_light[0],
-            ks[1] * specular_light[1],
-            ks[2] * specular_light[2]
-        };
-        result_color += specular_light;
-    }
-
-    return result_color * 255.f;
-}
-
-Eigen::Vector3f phong_fragment_shader(const fragment_shader_payload& payload)
+struct texture_fragment_shader : lit_shader
 {
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const
+    {
+        Eigen::Vector3f return_color = {0, 0, 0};
+        if (payload.texture)
+        {
+            // TODO: Get the texture value at the texture coordinates of the current fragment
+            return_color = payload.texture->getColorBilinear(payload.tex_coords.x(), payload.tex_coords.y());
+            // return_color = payload.texture->getColor(payload.tex_coords.x(), payload.tex_coords.y());
+        }
+        Eigen::Vector3f texture_color;
+        texture_color << return_color.x(), return_color.y(), return_color.z();
 
-    float p = 150;
+        Eigen::Vector3f kd = texture_color / 255.f;
 
-    Eigen::Vector3f color = payload.color;
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
+        Eigen::Vector3f color = texture_color;
+        Eigen::Vector3f point = payload.view_pos;
+        Eigen::Vector3f normal = payload.normal;
 
-    Eigen::Vector3f result_color = {0, 0, 0};
+        Eigen::Vector3f result_color = {0, 0, 0};
 
-    Vector3f amb_light = {
-        ka[0] * amb_light_intensity[0],
-        ka[1] * amb_light_intensity[1],
-        ka[2] * amb_light_intensity[2]
-    };
-    result_color += amb_light;
+        for (auto& light : lights)
+        {
+            // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
+            // components are. Then, accumulate that result on the *result_color* object.
+            Vector3f l = light.position - payload.view_pos;
+            auto light_arr = light.intensity / pow(l.norm(), 2);
+            l.normalize();
+            Vector3f v = (eye_pos - payload.view_pos).normalized();
+            Vector3f diffuse_light = light_arr * std::max(l.dot(payload.normal), 0.0f);
+            diffuse_light = {
+                diffuse_light[0] * kd[0],
+                diffuse_light[1] * kd[1],
+                diffuse_light[2] * kd[2]
+            };
+            result_color += diffuse_light;
+            Vector3f h = (v + l).normalized();
+            Vector3f specular_light = light_arr * pow(std::max(h.dot(payload.normal), 0.0f), p);
+            specular_light = {
+                ks[0] * specular_light[0],
+                ks[1] * specular_light[1],
+                ks[2] * specular_light[2]
+            };
+            result_color += specular_light;
+        }
 
-    for (auto& light : lights)
-    {
-        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-        // components are. Then, accumulate that result on the *result_color* object.
-        Vector3f l = light.position - payload.view_pos;
-        auto light_arr = light.intensity / pow(l.norm(), 2);
-        l.normalize();
-        Vector3f v = (eye_pos - payload.view_pos).normalized();
-        Vector3f diffuse_light = light_arr * std::max(l.dot(payload.normal), 0.0f);
-        diffuse_light = {
-            diffuse_light[0] * kd[0],
-            diffuse_light[1] * kd[1],
-            diffuse_light[2] * kd[2]
-        };
-        result_color += diffuse_light;
-        Vector3f h = (v + l).normalized();
-        Vector3f specular_light = light_arr * pow(std::max(h.dot(payload.normal), 0.0f), p);
-        specular_light = {
-            ks[0] * specular_light[0],
-            ks[1] * specular_light[1],
-            ks[2] * specular_light[2]
-        };
-        result_color += specular_light;
+        return result_color * 255.f;
     }
+};
 
-    return result_color * 255.f;
-}
-
+struct phong_fragment_shader : lit_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const
+    {
+        Eigen::Vector3f kd = payload.color;
 
+        Eigen::Vector3f color = payload.color;
+        Eigen::Vector3f point = payload.view_pos;
+        Eigen::Vector3f normal = payload.normal;
 
-Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payload)
-{
-    
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
+        Eigen::Vector3f result_color = {0, 0, 0};
 
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
+        Vector3f amb_light = {
+            ka[0] * amb_light_intensity[0],
+            ka[1] * amb_light_intensity[1],
+            ka[2] * amb_light_intensity[2]
+        };
+        result_color += amb_light;
 
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
+        for (auto& light : lights)
+        {
+            // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
+            // components are. Then, accumulate that result on the *result_color* object.
+            Vector3f l = light.position - payload.view_pos;
+            auto light_arr = light.intensity / pow(l.norm(), 2);
+            l.normalize();
+            Vector3f v = (eye_pos - payload.view_pos).normalized();
+            Vector3f diffuse_light = light_arr * std::max(l.dot(payload.normal), 0.0f);
+            diffuse_light = {
+                diffuse_light[0] * kd[0],
+                diffuse_light[1] * kd[1],
+                diffuse_light[2] * kd[2]
+            };
+            result_color += diffuse_light;
+            Vector3f h = (v + l).normalized();
+            Vector3f specular_light = light_arr * pow(std::max(h.dot(payload.normal), 0.0f), p);
+            specular_light = {
+                ks[0] * specular_light[0],
+                ks[1] * specular_light[1],
+                ks[2] * specular_light[2]
+            };
+            result_color += specular_light;
+        }
 
-    float p = 150;
+        return result_color * 255.f;
+    }
+};
 
-    Eigen::Vector3f color = payload.color; 
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
 
-    float kh = 0.2, kn = 0.1;
-    
-    // TODO: Implement displacement mapping here
-    // Let n = normal = (x, y, z)
-    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
-    // Vector b = n cross product t
-    // Matrix TBN = [t b n]
-    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
-    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
-    // Vector ln = (-dU, -dV, 1)
-    // Position p = p + kn * n * h(u,v)
-    // Normal n = normalize(TBN * ln)
-    Vector3f n = normal;
-    float x = n.x(), y = n.y(), z = n.z();
-    Vector3f t = {
-        x*y / sqrt(x*x+z*z),
-        sqrt(x*x+z*z),
-        z*y / sqrt(x*x+z*z)
-    };
-    Vector3f b = n.cross(t);
-    Matrix3f TBN;
-    TBN << t, b, n;
-    Texture *texture = payload.texture;
-    float u = payload.tex_coords.x();
-    float v = payload.tex_coords.y();
-    float dU = kh * kn * (texture->getColor(u + 1.0/texture->width, v).norm() - texture->getColor(u, v).norm());
-    float dV = kh * kn * (texture->getColor(u, v + 1.0/texture->height).norm() - texture->getColor(u, v).norm());
-    
-    Vector3f ln = { -dU, -dV, 1 };
-
-    point += kn * normal * texture->getColor(u, v).norm();
-
-    normal = (TBN * ln).normalized();
-
-    Eigen::Vector3f result_color = {0, 0, 0};
-
-    Vector3f amb_light = {
-        ka[0] * amb_light_intensity[0],
-        ka[1] * amb_light_intensity[1],
-        ka[2] * amb_light_intensity[2]
-    };
-    result_color += amb_light;
 
-    for (auto& light : lights)
+struct displacement_fragment_shader : lit_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const
     {
-        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-        // components are. Then, accumulate that result on the *result_color* object.
-        Vector3f l = light.position - point;
-        auto light_arr = light.intensity / pow(l.norm(), 2);
-        l.normalize();
-        Vector3f v = (eye_pos - point).normalized();
-        Vector3f diffuse_light = light_arr * std::max(l.dot(normal), 0.0f);
-        diffuse_light = {
-             kd[0] * diffuse_light[0],
-             kd[1] * diffuse_light[1],
-             kd[2] * diffuse_light[2]
+        Eigen::Vector3f kd = payload.color;
+
+        Eigen::Vector3f color = payload.color; 
+        Eigen::Vector3f point = payload.view_pos;
+        Eigen::Vector3f normal = payload.normal;
+
+        // TODO: Implement displacement mapping here
+        // Let n = normal = (x, y, z)
+        // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
+        // Vector b = n cross product t
+        // Matrix TBN = [t b n]
+        // dU = kh * kn * (h(u+1/w,v)-h(u,v))
+        // dV = kh * kn * (h(u,v+1/h)-h(u,v))
+        // Vector ln = (-dU, -dV, 1)
+        // Position p = p + kn * n * h(u,v)
+        // Normal n = normalize(TBN * ln)
+        Vector3f n = normal;
+        float x = n.x(), y = n.y(), z = n.z();
+        Vector3f t = {
+            x*y / sqrt(x*x+z*z),
+            sqrt(x*x+z*z),
+            z*y / sqrt(x*x+z*z)
         };
-        result_color += diffuse_light;
-        Vector3f h = (v + l).normalized();
-        Vector3f specular_light = light_arr * pow(std::max(h.dot(normal), 0.0f), p);
-        specular_light = {
-            ks[0] * specular_light[0],
-            ks[1] * specular_light[1],
-            ks[2] * specular_light[2]
-        };
-        result_color += specular_light;
-    }
+        Vector3f b = n.cross(t);
+        Matrix3f TBN;
+        TBN << t, b, n;
+        Texture *texture = payload.texture;
+        float u = payload.tex_coords.x();
+        float v = payload.tex_coords.y();
+        float dU = kh * kn * (texture->getColor(u + 1.0/texture->width, v).norm() - texture->getColor(u, v).norm());
+        float dV = kh * kn * (texture->getColor(u, v + 1.0/texture->height).norm() - texture->getColor(u, v).norm());
 
-    return result_color * 255.f;
-}
+        Vector3f ln = { -dU, -dV, 1 };
 
+        point += kn * normal * texture->getColor(u, v).norm();
 
-Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
-{
-    
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
+        normal = (TBN * ln).normalized();
 
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
+        Eigen::Vector3f result_color = {0, 0, 0};
 
-    float p = 150;
+        Vector3f amb_light = {
+            ka[0] * amb_light_intensity[0],
+            ka[1] * amb_light_intensity[1],
+            ka[2] * amb_light_intensity[2]
+        };
+        result_color += amb_light;
 
-    Eigen::Vector3f color = payload.color; 
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
+        for (auto& light : lights)
+        {
+            // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
+            // components are. Then, accumulate that result on the *result_color* object.
+            Vector3f l = light.position - point;
+            auto light_arr = light.intensity / pow(l.norm(), 2);
+            l.normalize();
+            Vector3f v = (eye_pos - point).normalized();
+            Vector3f diffuse_light = light_arr * std::max(l.dot(normal), 0.0f);
+            diffuse_light = {
+                 kd[0] * diffuse_light[0],
+                 kd[1] * diffuse_light[1],
+                 kd[2] * diffuse_light[2]
+            };
+            result_color += diffuse_light;
+            Vector3f h = (v + l).normalized();
+            Vector3f specular_light = light_arr * pow(std::max(h.dot(normal), 0.0f), p);
+            specular_light = {
+                ks[0] * specular_light[0],
+                ks[1] * specular_light[1],
+                ks[2] * specular_light[2]
+            };
+            result_color += specular_light;
+        }
 
+        return result_color * 255.f;
+    }
+};
 
-    float kh = 0.2, kn = 0.1;
 
-    // TODO: Implement bump mapping here
-    // Let n = normal = (x, y, z)
-    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
-    // Vector b = n cross product t
-    // Matrix TBN = [t b n]
-    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
-    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
-    // Vector ln = (-dU, -dV, 1)
-    // Normal n = normalize(TBN * ln)
-
-    Vector3f n = normal;
-    float x = n.x(), y = n.y(), z = n.z();
-    Vector3f t = {
-        x*y / sqrt(x*x+z*z),
-        sqrt(x*x+z*z),
-        z*y / sqrt(x*x+z*z)
-    };
-    Vector3f b = n.cross(t);
-    Matrix3f TBN;
-    TBN << t, b, n;
-    Texture *texture = payload.texture;
-    float u = payload.tex_coords.x();
-    float v = payload.tex_coords.y();
-    float dU = kh * kn * (texture->getColor(u + 1.0/texture->width, v).norm() - texture->getColor(u, v).norm());
-    float dV = kh * kn * (texture->getColor(u, v + 1.0/texture->height).norm() - texture->getColor(u, v).norm());
-    
-    Vector3f ln = { -dU, -dV, 1 };
-    normal = (TBN * ln).normalized();
-
-    Eigen::Vector3f result_color = {0, 0, 0};
-    result_color = normal;
-
-    return result_color * 255.f;
-}
+struct bump_fragment_shader : lit_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const
+    {
+        Eigen::Vector3f kd = payload.color;
+
+        Eigen::Vector3f color = payload.color; 
+        Eigen::Vector3f point = payload.view_pos;
+        Eigen::Vector3f normal = payload.normal;
+
+        // TODO: Implement bump mapping here
+        // Let n = normal = (x, y, z)
+        // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
+        // Vector b = n cross product t
+        // Matrix TBN = [t b n]
+        // dU = kh * kn * (h(u+1/w,v)-h(u,v))
+        // dV = kh * kn * (h(u,v+1/h)-h(u,v))
+        // Vector ln = (-dU, -dV, 1)
+        // Normal n = normalize(TBN * ln)
+
+        Vector3f n = normal;
+        float x = n.x(), y = n.y(), z = n.z();
+        Vector3f t = {
+            x*y / sqrt(x*x+z*z),
+            sqrt(x*x+z*z),
+            z*y / sqrt(x*x+z*z)
+        };
+        Vector3f b = n.cross(t);
+        Matrix3f TBN;
+        TBN << t, b, n;
+        Texture *texture = payload.texture;
+        float u = payload.tex_coords.x();
+        float v = payload.tex_coords.y();
+        float dU = kh * kn * (texture->getColor(u + 1.0/texture->width, v).norm() - texture->getColor(u, v).norm());
+        float dV = kh * kn * (texture->getColor(u, v + 1.0/texture->height).norm() - texture->getColor(u, v).norm());
+
+        Vector3f ln = { -dU, -dV, 1 };
+        normal = (TBN * ln).normalized();
+
+        Eigen::Vector3f result_color = {0, 0, 0};
+        result_color = normal;
+
+        return result_color * 255.f;
+    }
+};
 
 int main(int argc, const char** argv)
 {
-    std::vector<Triangle*> TriangleList;
+    std::vector<Eigen::Vector3f> positions, normals;
+    std::vector<Eigen::Vector2f> tex_coords;
+    std::vector<Eigen::Vector3i> indices;
 
     float angle = 140.0;
     bool command_line = false;
@@ -391,28 +374,44 @@ int main(int argc, const char** argv)
     std::string obj_path = "../models/spot/";
 
     // Load .obj File
+    // The loader repeats every corner; corners with the same position, normal and texture
+    // coordinate become one vertex of the indexed buffers, so it is transformed once per draw.
     bool loadout = Loader.LoadFile("../models/spot/spot_triangulated_good.obj");
+    std::map<std::array<float, 8>, int> vertex_index;
     for(auto mesh:Loader.LoadedMeshes)
     {
         for(int i=0;i<mesh.Vertices.size();i+=3)
         {
-            Triangle* t = new Triangle();
+            Eigen::Vector3i triangle;
             for(int j=0;j<3;j++)
             {
-                t->setVertex(j,Vector4f(mesh.Vertices[i+j].Position.X,mesh.Vertices[i+j].Position.Y,mesh.Vertices[i+j].Position.Z,1.0));
-                t->setNormal(j,Vector3f(mesh.Vertices[i+j].Normal.X,mesh.Vertices[i+j].Normal.Y,mesh.Vertices[i+j].Normal.Z));
-                t->setTexCoord(j,Vector2f(mesh.Vertices[i+j].TextureCoordinate.X, mesh.Vertices[i+j].TextureCoordinate.Y));
+                const objl::Vertex& v = mesh.Vertices[i+j];
+                std::array<float, 8> key = {v.Position.X, v.Position.Y, v.Position.Z, v.Normal.X, v.Normal.Y,
+                                            v.Normal.Z, v.TextureCoordinate.X, v.TextureCoordinate.Y};
+                auto it = vertex_index.emplace(key, int(positions.size())).first;
+                if (it->second == int(positions.size()))
+                {
+                    positions.emplace_back(v.Position.X, v.Position.Y, v.Position.Z);
+                    normals.emplace_back(v.Normal.X, v.Normal.Y, v.Normal.Z);
+                    tex_coords.emplace_back(v.TextureCoordinate.X, v.TextureCoordinate.Y);
+                }
+                triangle[j] = it->second;
             }
-            TriangleList.push_back(t);
+            indices.push_back(triangle);
         }
     }
 
     rst::rasterizer r(700, 700);
 
+    auto pos_id = r.load_positions(positions);
+    auto ind_id = r.load_indices(indices);
+    auto nor_id = r.load_normals(normals);
+    auto tex_id = r.load_tex_coords(tex_coords);
+
     auto texture_path = "hmap.jpg";
     r.set_texture(Texture(obj_path + texture_path));
 
-    std::function<Eigen::Vector3f(fragment_shader_payload)> active_shader = phong_fragment_shader;
+    std::string active_shader = "phong";
 
     if (argc >= 2)
     {
@@ -422,36 +421,57 @@ int main(int argc, const char** argv)
         if (argc == 3 && std::string(argv[2]) == "texture")
         {
             std::cout << "Rasterizing using the texture shader\n";
-            active_shader = texture_fragment_shader;
+            active_shader = "texture";
             texture_path = "spot_texture.png";
             r.set_texture(Texture(obj_path + texture_path));
         }
         else if (argc == 3 && std::string(argv[2]) == "normal")
         {
             std::cout << "Rasterizing using the normal shader\n";
-            active_shader = normal_fragment_shader;
+            active_shader = "normal";
         }
         else if (argc == 3 && std::string(argv[2]) == "phong")
         {
             std::cout << "Rasterizing using the phong shader\n";
-            active_shader = phong_fragment_shader;
+            active_shader = "phong";
         }
         else if (argc == 3 && std::string(argv[2]) == "bump")
         {
             std::cout << "Rasterizing using the bump shader\n";
-            active_shader = bump_fragment_shader;
+            active_shader = "bump";
         }
         else if (argc == 3 && std::string(argv[2]) == "displacement")
         {
             std::cout << "Rasterizing using the bump shader\n";
-            active_shader = displacement_fragment_shader;
+            active_shader = "displacement";
         }
     }
 
     Eigen::Vector3f eye_pos = {0,0,10};
+    // the projection's near and far planes, which the rasterizer clips against
+    float z_near = 0.1, z_far = 50;
+    r.set_clip_planes(z_near, z_far);
 
     r.set_vertex_shader(vertex_shader);
-    r.set_fragment_shader(active_shader);
+    // spot is closed: its back faces are always hidden
+    r.set_backface_culling(true);
+    r.set_frustum_culling(true);
+
+    // The rasterizer's shading loop is instantiated for every shader type. Shading stays forward for
+    // all of them: with its back faces culled, spot covers almost every pixel once, so deferring
+    // saves next to no shader calls and only adds the G-buffer round trip.
+    auto draw = [&]() {
+        if (active_shader == "texture")
+            r.draw(pos_id, ind_id, nor_id, tex_id, texture_fragment_shader());
+        else if (active_shader == "normal")
+            r.draw(pos_id, ind_id, nor_id, tex_id, normal_fragment_shader());
+        else if (active_shader == "bump")
+            r.draw(pos_id, ind_id, nor_id, tex_id, bump_fragment_shader());
+        else if (active_shader == "displacement")
+            r.draw(pos_id, ind_id, nor_id, tex_id, displacement_fragment_shader());
+        else
+            r.draw(pos_id, ind_id, nor_id, tex_id, phong_fragment_shader());
+    };
 
     int key = 0;
     int frame_count = 0;
@@ -461,31 +481,30 @@ int main(int argc, const char** argv)
         r.clear(rst::Buffers::Color | rst::Buffers::Depth);
         r.set_model(get_model_matrix(angle));
         r.set_view(get_view_matrix(eye_pos));
-        r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+        r.set_projection(get_projection_matrix(45.0, 1, z_near, z_far));
 
-        r.draw(TriangleList);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+        draw();
+        cv::Mat image(700, 700, CV_8UC3);
+        r.resolve(image.data, rst::PixelFormat::BGR8, image.step);
 
         cv::imwrite(filename, image);
 
         return 0;
     }
 
+    // the frames are resolved straight into the image OpenCV shows
+    cv::Mat image(700, 700, CV_8UC3);
     while(key != 27)
     {
         r.clear(rst::Buffers::Color | rst::Buffers::Depth);
 
         r.set_model(get_model_matrix(angle));
         r.set_view(get_view_matrix(eye_pos));
-        r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+        r.set_projection(get_projection_matrix(45.0, 1, z_near, z_far));
 
         //r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
-        r.draw(TriangleList);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+        draw();
+        r.resolve(image.data, rst::PixelFormat::BGR8, image.step);
 
         cv::imshow("image", image);
         cv::imwrite(filename, image);
@@ -3,10 +3,19 @@
 //
 
 #include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include "rasterizer.hpp"
 #include <opencv2/opencv.hpp>
 #include <math.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RASTERIZER_AVX2 1
+#endif
+
 
 rst::pos_buf_id rst::rasterizer::load_positions(const std::vector<Eigen::Vector3f> &positions)
 {
@@ -42,6 +51,14 @@ rst::col_buf_id rst::rasterizer::load_normals(const std::vector<Eigen::Vector3f>
     return {id};
 }
 
+rst::tex_buf_id rst::rasterizer::load_tex_coords(const std::vector<Eigen::Vector2f>& tex_coords)
+{
+    auto id = get_next_id();
+    tex_buf.emplace(id, tex_coords);
+
+    return {id};
+}
+
 
 // Bresenham's line drawing algorithm
 void rst::rasterizer::draw_line(Eigen::Vector3f begin, Eigen::Vector3f end)
@@ -149,95 +166,410 @@ auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
     return Vector4f(v3.x(), v3.y(), v3.z(), w);
 }
 
-static bool insideTriangle(int x, int y, const Vector4f* _v){
-    Vector3f v[3];
-    for(int i=0;i<3;i++)
-        v[i] = {_v[i].x(),_v[i].y(), 1.0};
-    Vector3f f0,f1,f2;
-    f0 = v[1].cross(v[0]);
-    f1 = v[2].cross(v[1]);
-    f2 = v[0].cross(v[2]);
-    Vector3f p(x,y,1.);
-    if((p.dot(f0)*f0.dot(v[2])>0) && (p.dot(f1)*f1.dot(v[0])>0) && (p.dot(f2)*f2.dot(v[1])>0))
+// Edge functions of a screen-space triangle, set up once per triangle. e_i(x, y) = a_i x + b_i y + c_i
+// is the signed area spanned by the edge opposite vertex i and the point, divided by the signed
+// area of the triangle, so the three values at a pixel are its barycentric coordinates and the
+// pixel is inside when all of them are positive, whatever the winding. Moving one pixel in x adds
+// a_i, so a row costs one evaluation at its start and three additions per pixel.
+struct EdgeFunctions
+{
+    float a[3], b[3], c[3];
+
+    // false for a triangle with no area, which covers no pixel
+    bool setup(const Vector4f* v)
+    {
+        float area = (v[1].x() - v[0].x()) * (v[2].y() - v[0].y()) - (v[2].x() - v[0].x()) * (v[1].y() - v[0].y());
+        if (area == 0)
+            return false;
+        float inv_area = 1.0f / area;
+        for (int i = 0; i < 3; i++) {
+            const Vector4f& p = v[(i + 1) % 3];
+            const Vector4f& q = v[(i + 2) % 3];
+            // (q - p) x ((x, y) - p)
+            a[i] = (p.y() - q.y()) * inv_area;
+            b[i] = (q.x() - p.x()) * inv_area;
+            c[i] = (p.x() * q.y() - q.x() * p.y()) * inv_area;
+        }
         return true;
-    return false;
+    }
+
+    void at(float x, float y, float* e) const
+    {
+        for (int i = 0; i < 3; i++)
+            e[i] = a[i] * x + b[i] * y + c[i];
+    }
+};
+
+#ifdef RASTERIZER_AVX2
+// Pixels x0..x1 of row y, at most a tile wide, 8 at a time: one mask per block marks the lanes
+// inside the triangle and in front of depth_row, the surviving depths go out with one masked
+// store, and the surviving pixels are appended to out, a rasterizer::RowFragments. The caller
+// shades them once this returns: shading from here, between 256-bit instructions, paid an AVX-SSE
+// transition penalty per pixel.
+template <typename Fragments>
+__attribute__((target("avx2"))) static void rasterize_row_avx2(const EdgeFunctions& edges, const float* inv_w, const float* z,
+                                                               int y, int x0, int x1, float* depth_row, Fragments& out)
+{
+    const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i lane_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    __m256 e[3], step[3], iw[3], vz[3];
+    for (int i = 0; i < 3; i++) {
+        __m256 a = _mm256_set1_ps(edges.a[i]);
+        e[i] = _mm256_add_ps(_mm256_set1_ps(edges.a[i] * x0 + edges.b[i] * y + edges.c[i]), _mm256_mul_ps(a, lane));
+        step[i] = _mm256_mul_ps(a, _mm256_set1_ps(8.0f));
+        iw[i] = _mm256_set1_ps(inv_w[i]);
+        vz[i] = _mm256_set1_ps(z[i]);
+    }
+
+    for (int x = x0; x <= x1; x += 8) {
+        __m256 in_row = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(x1 - x + 1), lane_index));
+        __m256 mask = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e[0], zero, _CMP_GT_OQ), _mm256_cmp_ps(e[1], zero, _CMP_GT_OQ)),
+                                    _mm256_and_ps(_mm256_cmp_ps(e[2], zero, _CMP_GT_OQ), in_row));
+        if (_mm256_movemask_ps(mask)) {
+            __m256 a0 = _mm256_mul_ps(e[0], iw[0]), a1 = _mm256_mul_ps(e[1], iw[1]), a2 = _mm256_mul_ps(e[2], iw[2]);
+            __m256 Z = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(a0, a1), a2));
+            __m256 zp = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a0, vz[0]), _mm256_mul_ps(a1, vz[1])),
+                                                    _mm256_mul_ps(a2, vz[2])), Z);
+            __m256 depth = _mm256_maskload_ps(depth_row + x, _mm256_castps_si256(mask));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(zp, depth, _CMP_LT_OQ));
+            int bits = _mm256_movemask_ps(mask);
+            if (bits) {
+                _mm256_maskstore_ps(depth_row + x, _mm256_castps_si256(mask), zp);
+                alignas(32) float p[3][8];
+                _mm256_store_ps(p[0], _mm256_mul_ps(a0, Z));
+                _mm256_store_ps(p[1], _mm256_mul_ps(a1, Z));
+                _mm256_store_ps(p[2], _mm256_mul_ps(a2, Z));
+                for (; bits; bits &= bits - 1) {
+                    int i = __builtin_ctz(bits);
+                    out.x[out.count] = x + i;
+                    for (int k = 0; k < 3; k++)
+                        out.p[k][out.count] = p[k][i];
+                    out.count++;
+                }
+            }
+        }
+        for (int i = 0; i < 3; i++)
+            e[i] = _mm256_add_ps(e[i], step[i]);
+    }
 }
 
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector4f* v){
-    float c1 = (x*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*y + v[1].x()*v[2].y() - v[2].x()*v[1].y()) / (v[0].x()*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*v[0].y() + v[1].x()*v[2].y() - v[2].x()*v[1].y());
-    float c2 = (x*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*y + v[2].x()*v[0].y() - v[0].x()*v[2].y()) / (v[1].x()*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*v[1].y() + v[2].x()*v[0].y() - v[0].x()*v[2].y());
-    float c3 = (x*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*y + v[0].x()*v[1].y() - v[1].x()*v[0].y()) / (v[2].x()*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*v[2].y() + v[0].x()*v[1].y() - v[1].x()*v[0].y());
-    return {c1,c2,c3};
+static bool cpu_has_avx2()
+{
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
 }
+#endif
 
-void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList) {
+// pixel bounding box of a screen-space triangle
+static void bounding_box(const Triangle& t, int& min_x, int& min_y, int& max_x, int& max_y)
+{
+    min_x = INT_MAX, max_x = INT_MIN, min_y = INT_MAX, max_y = INT_MIN;
+    for (int i = 0; i < 3; i++) {
+        int x = t.v[i].x();
+        int y = t.v[i].y();
+        min_x = x < min_x ? x : min_x;
+        max_x = x > max_x ? x : max_x;
+        min_y = y < min_y ? y : min_y;
+        max_y = y > max_y ? y : max_y;
+    }
+}
 
-    float f1 = (50 - 0.1) / 2.0;
-    float f2 = (50 + 0.1) / 2.0;
+// Runs body(begin, end, worker) on `workers` threads, worker w taking the w-th of `workers`
+// contiguous chunks of [0, n).
+template <typename Body>
+static void parallel_chunks(int n, int workers, Body&& body)
+{
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; w++)
+        threads.emplace_back([&, w] { body(int(int64_t(n) * w / workers), int(int64_t(n) * (w + 1) / workers), w); });
+    for (auto& thread : threads)
+        thread.join();
+}
 
-    Eigen::Matrix4f mvp = projection * view * model;
-    for (const auto& t:TriangleList)
-    {
-        Triangle newtri = *t;
+template <typename Distance>
+int rst::rasterizer::clip_polygon(const ClipVertex* in, int count, ClipVertex* out, Distance&& distance)
+{
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        const ClipVertex& a = in[i];
+        const ClipVertex& b = in[(i + 1) % count];
+        float da = distance(a), db = distance(b);
+        if (da >= 0)
+            out[n++] = a;
+        if ((da >= 0) != (db >= 0)) {
+            float s = da / (da - db);
+            out[n++] = {a.pos + s * (b.pos - a.pos), a.view_pos + s * (b.view_pos - a.view_pos),
+                        a.normal + s * (b.normal - a.normal), a.tex_coords + s * (b.tex_coords - a.tex_coords)};
+        }
+    }
+    return n;
+}
 
-        std::array<Eigen::Vector4f, 3> mm {
-                (view * model * t->v[0]),
-                (view * model * t->v[1]),
-                (view * model * t->v[2])
-        };
+rst::rasterizer::VertexTransform rst::rasterizer::vertex_transform() const
+{
+    VertexTransform xf;
+    xf.mv = view * model;
+    xf.mvp = projection * view * model;
+    xf.normal = xf.mv.inverse().transpose();
+    xf.handedness = projection(0, 0) * projection(1, 1) * xf.mv.topLeftCorner<3, 3>().determinant();
+    xf.w_sign = (projection * Eigen::Vector4f(0, 0, -1, 1)).w() > 0 ? 1 : -1;
+    return xf;
+}
 
-        std::array<Eigen::Vector3f, 3> viewspace_pos;
+rst::rasterizer::ClipVertex rst::rasterizer::transform_vertex(const VertexTransform& xf, const Eigen::Vector4f& pos,
+                                                              const Eigen::Vector3f& normal,
+                                                              const Eigen::Vector2f& tex_coords)
+{
+    ClipVertex v;
+    v.pos = xf.mvp * pos;
+    v.view_pos = (xf.mv * pos).head<3>();
+    //view space normal
+    v.normal = (xf.normal * to_vec4(normal, 0.0f)).head<3>();
+    v.tex_coords = tex_coords;
+    return v;
+}
 
-        std::transform(mm.begin(), mm.end(), viewspace_pos.begin(), [](auto& v) {
-            return v.template head<3>();
-        });
+int rst::rasterizer::assemble_triangle(const VertexTransform& xf, ClipVertex* polygon, ScreenTriangle* out) const
+{
+    float f1 = (z_far - z_near) / 2.0;
+    float f2 = (z_far + z_near) / 2.0;
+
+    // up to one extra vertex per clipping plane
+    ClipVertex clipped[5];
+
+    // Near and far clipping, before the homogeneous division, so no vertex has w close to 0 or
+    // behind the eye. The planes are given by view space depth, which is linear in clip space.
+    int count = 3;
+    auto near_plane = [&](const ClipVertex& v) { return -v.view_pos.z() - z_near; };
+    auto far_plane = [&](const ClipVertex& v) { return v.view_pos.z() + z_far; };
+    bool inside = true;
+    for (int i = 0; i < 3; i++)
+        inside &= near_plane(polygon[i]) >= 0 && far_plane(polygon[i]) >= 0;
+    if (!inside) {
+        count = clip_polygon(polygon, count, clipped, near_plane);
+        count = clip_polygon(clipped, count, polygon, far_plane);
+    }
 
-        Eigen::Vector4f v[] = {
-                mvp * t->v[0],
-                mvp * t->v[1],
-                mvp * t->v[2]
-        };
-        //Homogeneous division
-        for (auto& vec : v) {
-            vec.x()/=vec.w();
-            vec.y()/=vec.w();
-            vec.z()/=vec.w();
-        }
+    //Homogeneous division
+    for (int i = 0; i < count; i++) {
+        Eigen::Vector4f& vec = polygon[i].pos;
+        vec.x()/=vec.w();
+        vec.y()/=vec.w();
+        vec.z()/=vec.w();
+    }
 
-        Eigen::Matrix4f inv_trans = (view * model).inverse().transpose();
-        Eigen::Vector4f n[] = {
-                inv_trans * to_vec4(t->normal[0], 0.0f),
-                inv_trans * to_vec4(t->normal[1], 0.0f),
-                inv_trans * to_vec4(t->normal[2], 0.0f)
-        };
+    //Viewport transformation
+    for (int i = 0; i < count; i++)
+    {
+        Eigen::Vector4f& vert = polygon[i].pos;
+        vert.x() = 0.5*width*(vert.x()+1.0);
+        vert.y() = 0.5*height*(vert.y()+1.0);
+        vert.z() = vert.z() * f1 + f2;
+    }
 
-        //Viewport transformation
-        for (auto & vert : v)
-        {
-            vert.x() = 0.5*width*(vert.x()+1.0);
-            vert.y() = 0.5*height*(vert.y()+1.0);
-            vert.z() = vert.z() * f1 + f2;
+    if (cull_backfaces) {
+        // Counter-clockwise seen from the eye is front. The perspective division keeps the
+        // winding, as it divides x and y by the same w; a mirroring model-view or x/y scales of
+        // opposite sign in the projection reverse it.
+        float area = 0;
+        for (int i = 0; i < count; i++) {
+            const Eigen::Vector4f& a = polygon[i].pos;
+            const Eigen::Vector4f& b = polygon[(i + 1) % count].pos;
+            area += a.x() * b.y() - b.x() * a.y();
         }
+        if (area * xf.handedness <= 0)
+            return 0;
+    }
 
+    // the clipped polygon is convex: a fan around its first vertex
+    int triangles = std::max(count - 2, 0);
+    for (int k = 0; k < triangles; k++) {
+        const ClipVertex* corner[3] = {&polygon[0], &polygon[k + 1], &polygon[k + 2]};
+        Triangle& newtri = out[k].triangle;
         for (int i = 0; i < 3; ++i)
         {
             //screen space coordinates
-            newtri.setVertex(i, v[i]);
-        }
-
-        for (int i = 0; i < 3; ++i)
-        {
-            //view space normal
-            newtri.setNormal(i, n[i].head<3>());
+            newtri.setVertex(i, corner[i]->pos);
+            newtri.setNormal(i, corner[i]->normal);
+            newtri.setTexCoord(i, corner[i]->tex_coords);
+            out[k].view_pos[i] = corner[i]->view_pos;
         }
 
         newtri.setColor(0, 148,121.0,92.0);
         newtri.setColor(1, 148,121.0,92.0);
         newtri.setColor(2, 148,121.0,92.0);
+    }
+    return triangles;
+}
 
-        // Also pass view space vertice position
-        rasterize_triangle(newtri, viewspace_pos);
+bool rst::rasterizer::outside_frustum(const VertexTransform& xf, const Eigen::Vector3f& lo,
+                                      const Eigen::Vector3f& hi) const
+{
+    // The frustum is where -1 <= x/w, y/w <= 1 and the depth is between the planes. The side
+    // planes, multiplied through by w (whose sign in front of the eye depends on the projection),
+    // are planes in clip space, so the box is outside when all its corners are behind one of them.
+    float s = xf.w_sign;
+    bool out[6] = {true, true, true, true, true, true};
+    for (int c = 0; c < 8; c++) {
+        Eigen::Vector4f corner((c & 1) ? hi.x() : lo.x(), (c & 2) ? hi.y() : lo.y(), (c & 4) ? hi.z() : lo.z(), 1);
+        Eigen::Vector4f clip = xf.mvp * corner;
+        float z = xf.mv.row(2).dot(corner);
+        float d[6] = {s * (clip.w() - clip.x()), s * (clip.w() + clip.x()), s * (clip.w() - clip.y()),
+                      s * (clip.w() + clip.y()), -z - z_near, z + z_far};
+        for (int p = 0; p < 6; p++)
+            out[p] &= d[p] < 0;
     }
+    return out[0] || out[1] || out[2] || out[3] || out[4] || out[5];
+}
+
+template <typename Corners, typename Bounds>
+void rst::rasterizer::draw_triangles(const VertexTransform& xf, int count, Corners&& corners, Bounds&& bounds) {
+    int tiles_x = (width + tile_size - 1) / tile_size, tiles_y = (height + tile_size - 1) / tile_size;
+    screen_triangles.resize(count);
+    bins.resize(thread_count);
+    clipped.resize(thread_count);
+    for (auto& worker_bins : bins) {
+        worker_bins.resize(tiles_x * tiles_y);
+        for (auto& bin : worker_bins)
+            bin.clear();
+    }
+    for (auto& worker_clipped : clipped)
+        worker_clipped.clear();
+
+    // vertex processing and binning; worker w bins a contiguous range of the list, so reading the
+    // workers' bins in worker order visits a tile's triangles in list order
+    // the first piece of a clipped triangle takes its slot in screen_triangles, the others are
+    // appended to the worker's clipped list and binned as clipped_bit | their index there
+    parallel_chunks(count, thread_count, [&](int begin, int end, int worker) {
+        ScreenTriangle pieces[3];
+        for (int i = begin; i < end; i++) {
+            if (cull_frustum && (i - begin) % cluster_size == 0) {
+                int cluster_end = std::min(i + cluster_size, end);
+                Eigen::Vector3f lo = Eigen::Vector3f::Constant(std::numeric_limits<float>::infinity()), hi = -lo;
+                for (int j = i; j < cluster_end; j++)
+                    bounds(j, lo, hi);
+                if (outside_frustum(xf, lo, hi)) {
+                    i = cluster_end - 1;
+                    continue;
+                }
+            }
+            ClipVertex polygon[5];
+            corners(i, polygon);
+            int n = assemble_triangle(xf, polygon, pieces);
+            for (int k = 0; k < n; k++) {
+                uint32_t index = i;
+                if (k == 0) {
+                    screen_triangles[i] = pieces[0];
+                } else {
+                    index = clipped_bit | uint32_t(clipped[worker].size());
+                    clipped[worker].push_back(pieces[k]);
+                }
+                int min_x, min_y, max_x, max_y;
+                bounding_box(pieces[k].triangle, min_x, min_y, max_x, max_y);
+                if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height)
+                    continue;
+                int tx0 = std::max(min_x, 0) / tile_size, tx1 = std::min(max_x, width - 1) / tile_size;
+                int ty0 = std::max(min_y, 0) / tile_size, ty1 = std::min(max_y, height - 1) / tile_size;
+                // hierarchical z: tiles the earlier draws covered with nearer depths are skipped
+                const Triangle& t = pieces[k].triangle;
+                float nearest = std::min(t.v[0].z(), std::min(t.v[1].z(), t.v[2].z()));
+                for (int ty = ty0; ty <= ty1; ty++)
+                    for (int tx = tx0; tx <= tx1; tx++)
+                        if (!hierarchical_z || nearest < tile_zmax[ty * tiles_x + tx])
+                            bins[worker][ty * tiles_x + tx].push_back(index);
+            }
+        }
+    });
+
+    // the extra pieces go after the list, worker by worker
+    std::vector<uint32_t> clipped_base(thread_count);
+    for (int w = 0; w < thread_count; w++) {
+        clipped_base[w] = screen_triangles.size();
+        screen_triangles.insert(screen_triangles.end(), clipped[w].begin(), clipped[w].end());
+    }
+
+    // rasterization and shading, one tile at a time per thread; deferred, the tile is shaded right
+    // after its visibility pass, while its G-buffer is still in cache
+    std::atomic<int> next_tile{0};
+    parallel_chunks(thread_count, thread_count, [&](int, int, int) {
+        for (int tile = next_tile++; tile < tiles_x * tiles_y; tile = next_tile++) {
+            int x0 = tile % tiles_x * tile_size, y0 = tile / tiles_x * tile_size;
+            int x1 = std::min(x0 + tile_size, width) - 1, y1 = std::min(y0 + tile_size, height) - 1;
+            for (int w = 0; w < thread_count; w++)
+                for (uint32_t i : bins[w][tile])
+                    rasterize_triangle(i & clipped_bit ? clipped_base[w] + (i & ~clipped_bit) : i, x0, y0, x1, y1);
+            if (tile_shader)
+                tile_shader(x0, y0, x1, y1);
+            else if (deferred)
+                shade_tile(fragment_shader, x0, y0, x1, y1);
+            if (hierarchical_z) {
+                float farthest = -std::numeric_limits<float>::infinity();
+                for (int by = y0 / block_size; by <= y1 / block_size; by++)
+                    for (int bx = x0 / block_size; bx <= x1 / block_size; bx++)
+                        farthest = std::max(farthest, block_far(bx, by));
+                tile_zmax[tile] = farthest;
+            }
+        }
+    });
+}
+
+void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList) {
+    VertexTransform xf = vertex_transform();
+    draw_triangles(xf, TriangleList.size(),
+                   [&](int i, ClipVertex* polygon) {
+                       const Triangle& t = *TriangleList[i];
+                       for (int k = 0; k < 3; k++)
+                           polygon[k] = transform_vertex(xf, t.v[k], t.normal[k], t.tex_coords[k]);
+                   },
+                   [&](int i, Eigen::Vector3f& lo, Eigen::Vector3f& hi) {
+                       for (const Eigen::Vector4f& v : TriangleList[i]->v) {
+                           lo = lo.cwiseMin(v.head<3>());
+                           hi = hi.cwiseMax(v.head<3>());
+                       }
+                   });
+}
+
+// the buffer loaded with id, unlike buffers[id], which would add an empty one
+template <typename T>
+static const std::vector<T>& loaded_buffer(const std::map<int, std::vector<T>>& buffers, int id, const char* kind)
+{
+    auto found = buffers.find(id);
+    if (found == buffers.end())
+        throw std::runtime_error(std::string("no ") + kind + " buffer with id " + std::to_string(id));
+    return found->second;
+}
+
+void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id normal_buffer,
+                           tex_buf_id tex_buffer)
+{
+    auto& buf = loaded_buffer(pos_buf, pos_buffer.pos_id, "position");
+    auto& ind = loaded_buffer(ind_buf, ind_buffer.ind_id, "index");
+    auto& nor = loaded_buffer(nor_buf, normal_buffer.col_id, "normal");
+    auto& tex = loaded_buffer(tex_buf, tex_buffer.tex_id, "texture coordinate");
+    if (nor.size() != buf.size() || tex.size() != buf.size())
+        throw std::runtime_error("indexed draw needs as many normals and texture coordinates as positions");
+
+    // the post-transform cache: every vertex goes through the vertex stage once, however many
+    // triangles share it
+    VertexTransform xf = vertex_transform();
+    vertex_cache.resize(buf.size());
+    parallel_chunks(buf.size(), thread_count, [&](int begin, int end, int) {
+        for (int i = begin; i < end; i++)
+            vertex_cache[i] = transform_vertex(xf, to_vec4(buf[i], 1.0f), nor[i], tex[i]);
+    });
+
+    draw_triangles(xf, ind.size(),
+                   [&](int i, ClipVertex* polygon) {
+                       for (int k = 0; k < 3; k++)
+                           polygon[k] = vertex_cache[ind[i][k]];
+                   },
+                   [&](int i, Eigen::Vector3f& lo, Eigen::Vector3f& hi) {
+                       for (int k = 0; k < 3; k++) {
+                           lo = lo.cwiseMin(buf[ind[i][k]]);
+                           hi = hi.cwiseMax(buf[ind[i][k]]);
+                       }
+                   });
 }
 
 static Eigen::Vector3f interpolate(float alpha, float beta, float gamma, const Eigen::Vector3f& vert1, const Eigen::Vector3f& vert2, const Eigen::Vector3f& vert3, float weight)
@@ -257,7 +589,21 @@ static Eigen::Vector2f interpolate(float alpha, float beta, float gamma, const E
 }
 
 //Screen space rasterization
-void rst::rasterizer::rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& view_pos) 
+fragment_shader_payload rst::rasterizer::payload_at(uint32_t index, float p0, float p1, float p2)
+{
+    const ScreenTriangle& st = screen_triangles[index];
+    const Triangle& t = st.triangle;
+    auto interpolated_color = p0 * t.color[0] + p1 * t.color[1] + p2 * t.color[2];
+    auto interpolated_normal = p0 * t.normal[0] + p1 * t.normal[1] + p2 * t.normal[2];
+    auto interpolated_texcoords = p0 * t.tex_coords[0] + p1 * t.tex_coords[1] + p2 * t.tex_coords[2];
+    auto interpolated_shadingcoords = p0 * st.view_pos[0] + p1 * st.view_pos[1] + p2 * st.view_pos[2];
+
+    fragment_shader_payload payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
+    payload.view_pos = interpolated_shadingcoords;
+    return payload;
+}
+
+void rst::rasterizer::rasterize_triangle(uint32_t index, int x0, int y0, int x1, int y1)
 {
     // TODO: From your HW3, get the triangle rasterization code.
     // TODO: Inside your rasterization loop:
@@ -281,48 +627,149 @@ void rst::rasterizer::rasterize_triangle(const Triangle& t, const std::array<Eig
     // Use: auto pixel_color = fragment_shader(payload);
 
     
+    const ScreenTriangle& st = screen_triangles[index];
+    const Triangle& t = st.triangle;
     auto v = t.toVector4();
-    int min_x = INT_MAX, max_x = 0, min_y = INT_MAX, max_y = 0;
+    int min_x, min_y, max_x, max_y;
+    bounding_box(t, min_x, min_y, max_x, max_y);
+    min_x = std::max(min_x, x0);
+    min_y = std::max(min_y, y0);
+    max_x = std::min(max_x, x1);
+    max_y = std::min(max_y, y1);
+    if (min_x > max_x || min_y > max_y)
+        return;
+
+    // per-vertex terms of the perspective-correct interpolation
+    float inv_w[3], z[3];
     for (int i = 0; i < 3; i++) {
-        int x = v[i].x();
-        int y = v[i].y();
-        min_x = x < min_x ? x : min_x;
-        max_x = x > max_x ? x : max_x;
-        min_y = y < min_y ? y : min_y;
-        max_y = y > max_y ? y : max_y;
+        inv_w[i] = 1.0f / v[i].w();
+        z[i] = v[i].z();
     }
 
-    for (int x = min_x; x <= max_x; x++) {
-        for (int y = min_y; y <= max_y; y++) {
-            if (insideTriangle(x, y, t.v)) {
-                auto [alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-                float Z = 1.0 / (alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-                float zp = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-                zp *= Z;
-
-                if (zp >= depth_buf[get_index(x, y)]) 
-                    continue;
-
-                depth_buf[get_index(x, y)] = zp;
-
-                auto interpolated_color = (alpha * t.color[0] / v[0].w() + beta * t.color[1] / v[1].w() + gamma * t.color[2] / v[2].w()) * Z;
-                auto interpolated_normal = (alpha * t.normal[0] / v[0].w() + beta * t.normal[1] / v[1].w() + gamma * t.normal[2] / v[2].w()) * Z;
-                auto interpolated_texcoords = (alpha * t.tex_coords[0] / v[0].w() + beta * t.tex_coords[1] / v[1].w() + gamma * t.tex_coords[2] / v[2].w()) * Z;
-                auto interpolated_shadingcoords = (alpha * view_pos[0] / v[0].w() + beta * view_pos[1] / v[1].w() + gamma * view_pos[2] / v[2].w()) * Z;
-                // auto interpolated_color = interpolate(alpha, beta, gamma, t.color[0], t.color[1], t.color[2], Z);
-                // auto interpolated_normal = interpolate(alpha, beta, gamma, t.normal[0], t.normal[1], t.normal[2], Z);
-                // auto interpolated_texcoords = interpolate(alpha, beta, gamma, t.tex_coords[0], t.tex_coords[1], t.tex_coords[2], Z);
-                // auto interpolated_shadingcoords = (alpha * view_pos[0] / v[0].w() + beta * view_pos[1] / v[1].w() + gamma * view_pos[2] / v[2].w()) * Z;
-
-                fragment_shader_payload payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
-                payload.view_pos = interpolated_shadingcoords;
-                auto pixel_color = fragment_shader(payload);
-                set_pixel(Vector2i(x, y), pixel_color);
+    // Every depth of the triangle is a convex combination of the vertex depths, so none is nearer
+    // than the nearest vertex. With hierarchical z, only the columns of blocks between the first
+    // and the last block it may be visible in are rasterized, in every block row; nothing when there
+    // are none. Without, every row spans the bounding box.
+    int blocks_x = (width + block_size - 1) / block_size;
+    int by0 = min_y / block_size, by1 = max_y / block_size;
+    // the bounding box is within one tile
+    int span_x0[tile_size / block_size], span_x1[tile_size / block_size];
+    if (hierarchical_z) {
+        float nearest = std::min(z[0], std::min(z[1], z[2]));
+        int bx0 = min_x / block_size, bx1 = max_x / block_size;
+        bool visible = false;
+        for (int by = by0; by <= by1; by++) {
+            int first = bx1 + 1, last = bx0 - 1;
+            for (int bx = bx0; bx <= bx1; bx++) {
+                if (nearest < block_far(bx, by)) {
+                    first = std::min(first, bx);
+                    last = bx;
+                }
             }
+            span_x0[by - by0] = std::max(first * block_size, min_x);
+            span_x1[by - by0] = std::min(last * block_size + block_size - 1, max_x);
+            visible |= first <= last;
         }
+        if (!visible)
+            return;
+    } else {
+        std::fill(span_x0, span_x0 + by1 - by0 + 1, min_x);
+        std::fill(span_x1, span_x1 + by1 - by0 + 1, max_x);
     }
 
- 
+    EdgeFunctions edges;
+    if (!edges.setup(t.v))
+        return;
+
+    // the pixels of row y that passed the depth test: shaded now, by the templated draw()'s shader
+    // or the fragment shader, or deferred to shade_tile()
+    auto shade = [&](int y, const RowFragments& row) {
+        if (deferred) {
+            GSample* g_row = g_buf.data() + get_index(0, y);
+            for (int i = 0; i < row.count; i++)
+                g_row[row.x[i]] = {index, {row.p[0][i], row.p[1][i], row.p[2][i]}};
+        } else if (row_shader) {
+            row_shader(index, y, row);
+        } else {
+            shade_row(fragment_shader, index, y, row);
+        }
+        if (hierarchical_z) {
+            for (int i = 0; i < row.count; i++)
+                block_dirty[y / block_size * blocks_x + row.x[i] / block_size] = true;
+        }
+    };
+
+    // pixels xa..xb of row y
+    auto span = [&](int y, int xa, int xb) {
+        // x runs along the row, so the depths of a row are contiguous
+        float* depth_row = depth_buf.data() + get_index(0, y);
+        RowFragments fragments;
+#ifdef RASTERIZER_AVX2
+        if (cpu_has_avx2()) {
+            rasterize_row_avx2(edges, inv_w, z, y, xa, xb, depth_row, fragments);
+            shade(y, fragments);
+            return;
+        }
+#endif
+        float e[3];
+        edges.at(xa, y, e);
+        for (int x = xa; x <= xb; x++, e[0] += edges.a[0], e[1] += edges.a[1], e[2] += edges.a[2]) {
+            if (e[0] <= 0 || e[1] <= 0 || e[2] <= 0)
+                continue;
+            // barycentrics over w; Z is the interpolated view space depth
+            float a0 = e[0] * inv_w[0], a1 = e[1] * inv_w[1], a2 = e[2] * inv_w[2];
+            float Z = 1.0f / (a0 + a1 + a2);
+            float zp = (a0 * z[0] + a1 * z[1] + a2 * z[2]) * Z;
+
+            if (zp >= depth_row[x])
+                continue;
+            depth_row[x] = zp;
+            fragments.x[fragments.count] = x;
+            fragments.p[0][fragments.count] = a0 * Z;
+            fragments.p[1][fragments.count] = a1 * Z;
+            fragments.p[2][fragments.count] = a2 * Z;
+            fragments.count++;
+        }
+        shade(y, fragments);
+    };
+
+    for (int y = min_y; y <= max_y; y++) {
+        int row = y / block_size - by0;
+        if (span_x0[row] <= span_x1[row])
+            span(y, span_x0[row], span_x1[row]);
+    }
+}
+
+float rst::rasterizer::block_far(int bx, int by)
+{
+    int i = by * ((width + block_size - 1) / block_size) + bx;
+    if (block_dirty[i]) {
+        block_zmax[i] = farthest_depth(bx * block_size, by * block_size);
+        block_dirty[i] = false;
+    }
+    return block_zmax[i];
+}
+
+float rst::rasterizer::farthest_depth(int x0, int y0)
+{
+    int y1 = std::min(y0 + block_size, height);
+    float farthest[block_size];
+    std::fill(farthest, farthest + block_size, -std::numeric_limits<float>::infinity());
+    if (x0 + block_size <= width) {
+        // a fixed number of columns, which the compiler turns into one vector max per row
+        for (int y = y0; y < y1; y++) {
+            const float* depth_row = depth_buf.data() + get_index(x0, y);
+            for (int i = 0; i < block_size; i++)
+                farthest[i] = farthest[i] < depth_row[i] ? depth_row[i] : farthest[i];
+        }
+    } else {
+        for (int y = y0; y < y1; y++) {
+            const float* depth_row = depth_buf.data() + get_index(x0, y);
+            for (int i = 0; i < width - x0; i++)
+                farthest[i] = farthest[i] < depth_row[i] ? depth_row[i] : farthest[i];
+        }
+    }
+    return *std::max_element(farthest, farthest + block_size);
 }
 
 void rst::rasterizer::set_model(const Eigen::Matrix4f& m)
@@ -349,29 +796,85 @@ void rst::rasterizer::clear(rst::Buffers buff)
     if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
     {
         std::fill(depth_buf.begin(), depth_buf.end(), std::numeric_limits<float>::infinity());
+        std::fill(block_zmax.begin(), block_zmax.end(), std::numeric_limits<float>::infinity());
+        std::fill(block_dirty.begin(), block_dirty.end(), false);
+        std::fill(tile_zmax.begin(), tile_zmax.end(), std::numeric_limits<float>::infinity());
     }
 }
 
 rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
 {
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
     frame_buf.resize(w * h);
     depth_buf.resize(w * h);
+    g_buf.resize(w * h);
+    block_zmax.resize(((w + block_size - 1) / block_size) * ((h + block_size - 1) / block_size),
+                      std::numeric_limits<float>::infinity());
+    block_dirty.resize(block_zmax.size());
+    tile_zmax.resize(((w + tile_size - 1) / tile_size) * ((h + tile_size - 1) / tile_size),
+                     std::numeric_limits<float>::infinity());
 
     texture = std::nullopt;
 }
 
 int rst::rasterizer::get_index(int x, int y)
 {
-    return (height-y)*width + x;
+    return (height-1-y)*width + x;
 }
 
 void rst::rasterizer::set_pixel(const Vector2i &point, const Eigen::Vector3f &color)
 {
     //old index: auto ind = point.y() + point.x() * width;
-    int ind = (height-point.y())*width + point.x();
+    int ind = (height-1-point.y())*width + point.x();
     frame_buf[ind] = color;
 }
 
+// cv::saturate_cast<uchar>: rounds to nearest even, then clamps
+static uint8_t to_unorm8(float v)
+{
+    return uint8_t(std::min(std::max(lrintf(v), 0L), 255L));
+}
+
+// rows are split over thread_count threads
+void rst::rasterizer::resolve(void* dst, PixelFormat format, size_t stride) const
+{
+    if (format == PixelFormat::RGB32F_Planar) {
+        if (stride == 0)
+            stride = width * sizeof(float);
+        parallel_chunks(height, thread_count, [&](int begin, int end, int) {
+            for (int y = begin; y < end; y++) {
+                float* planes[3];
+                for (int c = 0; c < 3; c++)
+                    planes[c] = (float*)((char*)dst + (c * height + y) * stride);
+                const Eigen::Vector3f* src = &frame_buf[y * width];
+                for (int x = 0; x < width; x++)
+                    for (int c = 0; c < 3; c++)
+                        planes[c][x] = src[x][c];
+            }
+        });
+        return;
+    }
+
+    int channels = format == PixelFormat::RGBA8 || format == PixelFormat::BGRA8 ? 4 : 3;
+    // the channel of frame_buf that goes first in dst
+    int first = format == PixelFormat::BGR8 || format == PixelFormat::BGRA8 ? 2 : 0;
+    if (stride == 0)
+        stride = width * channels;
+    parallel_chunks(height, thread_count, [&](int begin, int end, int) {
+        for (int y = begin; y < end; y++) {
+            uint8_t* out = (uint8_t*)dst + y * stride;
+            const Eigen::Vector3f* src = &frame_buf[y * width];
+            for (int x = 0; x < width; x++, out += channels) {
+                out[0] = to_unorm8(src[x][first]);
+                out[1] = to_unorm8(src[x][1]);
+                out[2] = to_unorm8(src[x][2 - first]);
+                if (channels == 4)
+                    out[3] = 255;
+            }
+        }
+    });
+}
+
 void rst::rasterizer::set_vertex_shader(std::function<Eigen::Vector3f(vertex_shader_payload)> vert_shader)
 {
     vertex_shader = vert_shader;
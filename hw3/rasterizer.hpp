@@ -7,6 +7,8 @@
 #include <eigen3/Eigen/Eigen>
 #include <optional>
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include "global.hpp"
 #include "Shader.hpp"
 #include "Triangle.hpp"
@@ -37,6 +39,18 @@ namespace rst
         Triangle
     };
 
+    // Layouts resolve() writes the color buffer in. The 8 bit ones round every channel and clamp
+    // it to [0, 255], as cv::Mat::convertTo does; BGR8 is what OpenCV shows and writes, and the
+    // alpha of RGBA8/BGRA8 is 255. RGB32F_Planar is three float planes: red, green, then blue.
+    enum class PixelFormat
+    {
+        RGB8,
+        BGR8,
+        RGBA8,
+        BGRA8,
+        RGB32F_Planar
+    };
+
     /*
      * For the curious : The draw function takes two buffer id's as its arguments. These two structs
      * make sure that if you mix up with their orders, the compiler won't compile it.
@@ -57,6 +71,11 @@ namespace rst
         int col_id = 0;
     };
 
+    struct tex_buf_id
+    {
+        int tex_id = 0;
+    };
+
     class rasterizer
     {
     public:
@@ -65,12 +84,38 @@ namespace rst
         ind_buf_id load_indices(const std::vector<Eigen::Vector3i>& indices);
         col_buf_id load_colors(const std::vector<Eigen::Vector3f>& colors);
         col_buf_id load_normals(const std::vector<Eigen::Vector3f>& normals);
+        tex_buf_id load_tex_coords(const std::vector<Eigen::Vector2f>& tex_coords);
 
         void set_model(const Eigen::Matrix4f& m);
         void set_view(const Eigen::Matrix4f& v);
         void set_projection(const Eigen::Matrix4f& p);
+        // The near and far planes, as distances in front of the eye: triangles are clipped against
+        // them and their depths mapped to the depth range. They must be those of the projection.
+        void set_clip_planes(float near_plane, float far_plane)
+        {
+            z_near = near_plane;
+            z_far = far_plane;
+        }
 
         void set_texture(Texture tex) { texture = tex; }
+        // Deferred shading: draw() first finds the visible triangle of every pixel, storing its index
+        // and the pixel's barycentrics in a G-buffer, then runs the fragment shader once per pixel.
+        // The image is the same; the shader cost no longer grows with the depth complexity, for a
+        // G-buffer write and read per covered pixel.
+        void set_deferred(bool on) { deferred = on; }
+        // Culling by the triangle draw()s, for the draws after the call. Back faces are told by the
+        // sign of their screen-space area: counter-clockwise seen from the eye, as in the OBJ files,
+        // is front. Frustum culling boxes every run of cluster_size consecutive triangles
+        // in model space and skips the run when the box is outside the view frustum.
+        void set_backface_culling(bool on) { cull_backfaces = on; }
+        void set_frustum_culling(bool on) { cull_frustum = on; }
+        static constexpr int cluster_size = 64;
+        // Hierarchical z, off by default: the farthest depth of every block_size square and of every
+        // tile is kept. A triangle is not binned to the tiles earlier draws covered with nearer
+        // depths, and skips the blocks of its tiles that are nearer than it. A single draw of
+        // small triangles, like spot, rejects too little to pay for the bookkeeping, so main leaves
+        // it off; it only pays for scenes drawn in several draws, roughly front to back.
+        void set_hierarchical_z(bool on) { hierarchical_z = on; }
 
         void set_vertex_shader(std::function<Eigen::Vector3f(vertex_shader_payload)> vert_shader);
         void set_fragment_shader(std::function<Eigen::Vector3f(fragment_shader_payload)> frag_shader);
@@ -80,14 +125,147 @@ namespace rst
         void clear(Buffers buff);
 
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
+        // Two phases, each spread over thread_count threads: the triangles are transformed and
+        // binned into tile_size x tile_size screen tiles, then every tile is rasterized and shaded
+        // by one thread, which owns its pixels. Within a tile triangles keep their list order.
         void draw(std::vector<Triangle *> &TriangleList);
+        // draw(TriangleList) with a fragment shader known at compile time: any type with
+        // Eigen::Vector3f operator()(const fragment_shader_payload&) const, whose members are its
+        // uniform block, set up once for the draw. The shading loop, over a tile's G-buffer when
+        // deferred and over the fragments of a row otherwise, is instantiated for the type, so the
+        // shader is inlined there instead of called through std::function.
+        template <typename Shader>
+        void draw(std::vector<Triangle *> &TriangleList, const Shader& shader)
+        {
+            draw_with(shader, [&]() { draw(TriangleList); });
+        }
+
+        // Indexed triangles: every vertex of the buffers is transformed once, into a post-transform
+        // cache the triangles are assembled from, instead of once per corner. The buffers are
+        // parallel, one position, normal and texture coordinate per vertex; std::runtime_error is
+        // thrown for an id no buffer was loaded with, or normals or texture coordinates that are not
+        // as many as the positions.
+        void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id normal_buffer, tex_buf_id tex_buffer);
+        template <typename Shader>
+        void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id normal_buffer, tex_buf_id tex_buffer,
+                  const Shader& shader)
+        {
+            draw_with(shader, [&]() { draw(pos_buffer, ind_buffer, normal_buffer, tex_buffer); });
+        }
+
+        static constexpr int tile_size = 64;
+        static constexpr int block_size = 8;
+        int thread_count;
 
         std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
+        // Converts the color buffer, top row first, into dst in one pass, so a display or an encoder
+        // can take it without an intermediate image. stride is the bytes from a row of dst to the
+        // next (a plane of the planar format is height rows); 0 means tightly packed.
+        void resolve(void* dst, PixelFormat format, size_t stride = 0) const;
 
     private:
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
 
-        void rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& world_pos);
+        // screen-space triangle with the view space positions of its vertices
+        struct ScreenTriangle
+        {
+            Triangle triangle;
+            std::array<Eigen::Vector3f, 3> view_pos;
+        };
+
+        // A vertex out of the vertex stage, or made by clipping: its clip space position and the
+        // attributes interpolated across triangles, all of which vary linearly in clip space.
+        struct ClipVertex
+        {
+            Eigen::Vector4f pos;
+            Eigen::Vector3f view_pos;
+            Eigen::Vector3f normal;
+            Eigen::Vector2f tex_coords;
+        };
+
+        // the transforms of a draw, with the model-view inverse for the normals computed once, and
+        // what culling needs of them: the sign of the screen-space area of front faces, and the
+        // sign of w in front of the eye
+        struct VertexTransform
+        {
+            Eigen::Matrix4f mv, mvp, normal;
+            float handedness, w_sign;
+        };
+        VertexTransform vertex_transform() const;
+        static ClipVertex transform_vertex(const VertexTransform& xf, const Eigen::Vector4f& pos,
+                                           const Eigen::Vector3f& normal, const Eigen::Vector2f& tex_coords);
+        // One Sutherland-Hodgman step: the part of the polygon in[0..count) where distance() is not
+        // negative goes to out, keeping the winding. Returns its vertex count, at most count + 1.
+        template <typename Distance>
+        static int clip_polygon(const ClipVertex* in, int count, ClipVertex* out, Distance&& distance);
+        // Clipping against the near and far planes, division, viewport and back-face culling of the
+        // triangle polygon[0..3), which has room for 5 vertices: writes the triangles it is cut
+        // into, at most 3, to out and returns their number.
+        int assemble_triangle(const VertexTransform& xf, ClipVertex* polygon, ScreenTriangle* out) const;
+        // whether the model space box is entirely outside the view frustum
+        bool outside_frustum(const VertexTransform& xf, const Eigen::Vector3f& lo, const Eigen::Vector3f& hi) const;
+        // The binning and tile passes of both draw()s over count triangles transformed by xf:
+        // corners(i, polygon) writes the vertices of triangle i, bounds(i, lo, hi) grows a box by its
+        // model space corners.
+        template <typename Corners, typename Bounds>
+        void draw_triangles(const VertexTransform& xf, int count, Corners&& corners, Bounds&& bounds);
+        // screen_triangles[index]; only the pixels in [x0, x1] x [y0, y1] are touched
+        void rasterize_triangle(uint32_t index, int x0, int y0, int x1, int y1);
+        // the interpolated attributes of screen_triangles[index] at weights p0, p1, p2
+        fragment_shader_payload payload_at(uint32_t index, float p0, float p1, float p2);
+
+        // runs draw() with tile_shader or row_shader shading through shader
+        template <typename Shader, typename Draw>
+        void draw_with(const Shader& shader, Draw&& draw)
+        {
+            if (deferred)
+                tile_shader = [&](int x0, int y0, int x1, int y1) { shade_tile(shader, x0, y0, x1, y1); };
+            else
+                row_shader = [&](uint32_t index, int y, const RowFragments& row) { shade_row(shader, index, y, row); };
+            try {
+                draw();
+            } catch (...) {
+                tile_shader = nullptr;
+                row_shader = nullptr;
+                throw;
+            }
+            tile_shader = nullptr;
+            row_shader = nullptr;
+        }
+
+        // the pixels of a row, at most a tile wide, that passed the depth test, with their
+        // perspective-correct weights
+        struct RowFragments
+        {
+            int count = 0;
+            int x[tile_size];
+            float p[3][tile_size];
+        };
+
+        // forward shading of the fragments of screen_triangles[index] in row y
+        template <typename Shader>
+        void shade_row(const Shader& shader, uint32_t index, int y, const RowFragments& row)
+        {
+            for (int i = 0; i < row.count; i++)
+                set_pixel(Vector2i(row.x[i], y), shader(payload_at(index, row.p[0][i], row.p[1][i], row.p[2][i])));
+        }
+
+        // Every visible sample of the tile is shaded and taken out of the G-buffer, so the next draw
+        // shades only what it covers.
+        template <typename Shader>
+        void shade_tile(const Shader& shader, int x0, int y0, int x1, int y1)
+        {
+            for (int y = y0; y <= y1; y++) {
+                GSample* row = g_buf.data() + get_index(0, y);
+                for (int x = x0; x <= x1; x++) {
+                    GSample& sample = row[x];
+                    if (sample.triangle == GSample::none)
+                        continue;
+                    set_pixel(Vector2i(x, y), shader(payload_at(sample.triangle, sample.p[0], sample.p[1], sample.p[2])));
+                    sample.triangle = GSample::none;
+                }
+            }
+        }
 
         // VERTEX SHADER -> MVP -> Clipping -> /.W -> VIEWPORT -> DRAWLINE/DRAWTRI -> FRAGSHADER
 
@@ -102,6 +280,7 @@ namespace rst
         std::map<int, std::vector<Eigen::Vector3i>> ind_buf;
         std::map<int, std::vector<Eigen::Vector3f>> col_buf;
         std::map<int, std::vector<Eigen::Vector3f>> nor_buf;
+        std::map<int, std::vector<Eigen::Vector2f>> tex_buf;
 
         std::optional<Texture> texture;
 
@@ -110,6 +289,48 @@ namespace rst
 
         std::vector<Eigen::Vector3f> frame_buf;
         std::vector<float> depth_buf;
+
+        // the visible triangle (an index into screen_triangles) and its perspective-correct weights
+        // at every pixel, in deferred mode
+        struct GSample
+        {
+            static constexpr uint32_t none = UINT32_MAX;
+            uint32_t triangle = none;
+            float p[3];
+        };
+        std::vector<GSample> g_buf;
+        bool deferred = false;
+        bool cull_backfaces = false, cull_frustum = false;
+        // set by the templated draw()s to shade with their shader: a tile deferred, a row of
+        // screen_triangles[index] forward
+        std::function<void(int, int, int, int)> tile_shader;
+        std::function<void(uint32_t, int, const RowFragments&)> row_shader;
+
+        // Hierarchical z: the farthest depth in each block_size square of depth_buf. Writing a pixel
+        // marks its block dirty, and a dirty block is rescanned the next time a triangle is tested
+        // against it; a triangle whose nearest vertex is not nearer fails the depth test everywhere
+        // in the block. One byte per flag, as blocks of different tiles are written concurrently.
+        // tile_zmax is the farthest depth of every tile as its last tile pass left it, for binning.
+        // Depths only get nearer until cleared, so values left stale while it was off are still
+        // safe bounds.
+        bool hierarchical_z = false;
+        std::vector<float> block_zmax;
+        std::vector<uint8_t> block_dirty;
+        std::vector<float> tile_zmax;
+        float block_far(int bx, int by);
+        float farthest_depth(int x0, int y0);
+
+        // kept between draws to reuse their memory: the transformed triangles, and for every
+        // binning thread and tile the indices of the triangles overlapping the tile
+        std::vector<ScreenTriangle> screen_triangles;
+        std::vector<ClipVertex> vertex_cache;
+        std::vector<std::vector<std::vector<uint32_t>>> bins;
+        // per binning thread, the pieces of clipped triangles after their first
+        std::vector<std::vector<ScreenTriangle>> clipped;
+        static constexpr uint32_t clipped_bit = 0x80000000u;
+
+        // set by set_clip_planes()
+        float z_near = 0.1f, z_far = 50;
         int get_index(int x, int y);
 
         int width, height;
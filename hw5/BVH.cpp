@@ -0,0 +1,254 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+constexpr int kBucketCount = 12;
+constexpr int kStackSize = 64;
+} // namespace
+
+BVHAccel::BVHAccel(const std::vector<std::unique_ptr<Object> >& objects, int maxPrims)
+    : maxPrimsInNode(std::min(255, std::max(1, maxPrims)))
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for (const auto& object : objects)
+    {
+        for (uint32_t k = 0; k < object->getPrimitiveCount(); ++k)
+        {
+            Bounds3 bounds = object->getBounds(k);
+            primitives.push_back({object.get(), k, bounds, bounds.Centroid()});
+        }
+    }
+    if (primitives.empty())
+        return;
+
+    nodes.reserve(2 * primitives.size());
+    recursiveBuild(0, primitives.size());
+
+    auto stop = std::chrono::steady_clock::now();
+    printf("BVH Generation complete: %zu primitives, %zu nodes, %lld ms\n", primitives.size(), nodes.size(),
+           (long long)std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count());
+}
+
+uint32_t BVHAccel::recursiveBuild(uint32_t start, uint32_t end)
+{
+    uint32_t nodeIndex = nodes.size();
+    nodes.emplace_back();
+
+    Bounds3 bounds, centroidBounds;
+    for (uint32_t i = start; i < end; ++i)
+    {
+        bounds = Union(bounds, primitives[i].bounds);
+        centroidBounds = Union(centroidBounds, primitives[i].centroid);
+    }
+
+    auto makeLeaf = [&]() {
+        LinearNode& node = nodes[nodeIndex];
+        node.bounds = bounds;
+        node.primitivesOffset = start;
+        node.nPrimitives = end - start;
+        node.axis = 0;
+        return nodeIndex;
+    };
+
+    uint32_t count = end - start;
+    int dim = centroidBounds.maxExtent();
+    if (count == 1 || centroidBounds.pMax[dim] == centroidBounds.pMin[dim])
+    {
+        if (count <= (uint32_t)maxPrimsInNode)
+            return makeLeaf();
+    }
+
+    uint32_t mid = start + count / 2;
+    if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim])
+    {
+        // Every centroid coincides, just cut the range in half.
+        std::nth_element(&primitives[start], &primitives[mid], &primitives[end - 1] + 1,
+                         [dim](const Primitive& a, const Primitive& b) { return a.centroid[dim] < b.centroid[dim]; });
+    }
+    else
+    {
+        // Surface area heuristic evaluated over equally sized buckets along the widest axis.
+        struct Bucket
+        {
+            int count = 0;
+            Bounds3 bounds;
+        } buckets[kBucketCount];
+
+        auto bucketOf = [&](const Primitive& p) {
+            int b = kBucketCount * centroidBounds.Offset(p.centroid)[dim];
+            return std::min(b, kBucketCount - 1);
+        };
+        for (uint32_t i = start; i < end; ++i)
+        {
+            Bucket& b = buckets[bucketOf(primitives[i])];
+            b.count++;
+            b.bounds = Union(b.bounds, primitives[i].bounds);
+        }
+
+        float cost[kBucketCount - 1];
+        for (int i = 0; i < kBucketCount - 1; ++i)
+        {
+            Bounds3 b0, b1;
+            int count0 = 0, count1 = 0;
+            for (int j = 0; j <= i; ++j)
+            {
+                b0 = Union(b0, buckets[j].bounds);
+                count0 += buckets[j].count;
+            }
+            for (int j = i + 1; j < kBucketCount; ++j)
+            {
+                b1 = Union(b1, buckets[j].bounds);
+                count1 += buckets[j].count;
+            }
+            cost[i] = 0.125f + (count0 * (count0 ? b0.SurfaceArea() : 0) + count1 * (count1 ? b1.SurfaceArea() : 0)) /
+                                   bounds.SurfaceArea();
+        }
+
+        int minBucket = std::min_element(cost, cost + kBucketCount - 1) - cost;
+        if (count <= (uint32_t)maxPrimsInNode && cost[minBucket] >= count)
+            return makeLeaf();
+
+        Primitive* pmid = std::partition(&primitives[start], &primitives[end - 1] + 1,
+                                         [&](const Primitive& p) { return bucketOf(p) <= minBucket; });
+        mid = pmid - &primitives[0];
+        if (mid == start || mid == end)
+        {
+            mid = start + count / 2;
+            std::nth_element(&primitives[start], &primitives[mid], &primitives[end - 1] + 1,
+                             [dim](const Primitive& a, const Primitive& b) { return a.centroid[dim] < b.centroid[dim]; });
+        }
+    }
+
+    recursiveBuild(start, mid);
+    uint32_t secondChild = recursiveBuild(mid, end);
+
+    // nodes may have been reallocated by the recursive calls, so index again.
+    LinearNode& node = nodes[nodeIndex];
+    node.bounds = bounds;
+    node.secondChildOffset = secondChild;
+    node.nPrimitives = 0;
+    node.axis = dim;
+    return nodeIndex;
+}
+
+// [comment]
+// Returns the closest intersection of the ray with the scene, if any.
+//
+// Nodes are visited front to back: the child on the near side of the split axis is
+// traversed first and the far one is pushed on the stack. Boxes starting beyond the
+// closest hit found so far are skipped.
+// [/comment]
+std::optional<hit_payload> BVHAccel::Intersect(const Vector3f& orig, const Vector3f& dir) const
+{
+    std::optional<hit_payload> payload;
+    if (nodes.empty())
+        return payload;
+
+    Vector3f invDir(1 / dir.x, 1 / dir.y, 1 / dir.z);
+    std::array<int, 3> dirIsNeg = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+    float tNear = kInfinity;
+
+    uint32_t toVisit[kStackSize];
+    int toVisitOffset = 0;
+    uint32_t current = 0;
+    while (true)
+    {
+        const LinearNode& node = nodes[current];
+        if (node.bounds.IntersectP(orig, invDir, dirIsNeg, tNear))
+        {
+            if (node.nPrimitives > 0)
+            {
+                for (uint32_t i = 0; i < node.nPrimitives; ++i)
+                {
+                    const Primitive& p = primitives[node.primitivesOffset + i];
+                    float tNearK = kInfinity;
+                    uint32_t indexK;
+                    Vector2f uvK;
+                    if (p.object->intersectPrimitive(orig, dir, p.index, tNearK, indexK, uvK) && tNearK < tNear)
+                    {
+                        payload.emplace();
+                        payload->hit_obj = p.object;
+                        payload->tNear = tNearK;
+                        payload->index = indexK;
+                        payload->uv = uvK;
+                        tNear = tNearK;
+                    }
+                }
+                if (toVisitOffset == 0)
+                    break;
+                current = toVisit[--toVisitOffset];
+            }
+            else if (dirIsNeg[node.axis])
+            {
+                toVisit[toVisitOffset++] = current + 1;
+                current = node.secondChildOffset;
+            }
+            else
+            {
+                toVisit[toVisitOffset++] = node.secondChildOffset;
+                current = current + 1;
+            }
+        }
+        else
+        {
+            if (toVisitOffset == 0)
+                break;
+            current = toVisit[--toVisitOffset];
+        }
+    }
+
+    return payload;
+}
+
+bool BVHAccel::IntersectP(const Vector3f& orig, const Vector3f& dir, float tMax) const
+{
+    if (nodes.empty())
+        return false;
+
+    Vector3f invDir(1 / dir.x, 1 / dir.y, 1 / dir.z);
+    std::array<int, 3> dirIsNeg = {invDir.x < 0, invDir.y < 0, invDir.z < 0};
+
+    uint32_t toVisit[kStackSize];
+    int toVisitOffset = 0;
+    uint32_t current = 0;
+    while (true)
+    {
+        const LinearNode& node = nodes[current];
+        if (node.bounds.IntersectP(orig, invDir, dirIsNeg, tMax))
+        {
+            if (node.nPrimitives > 0)
+            {
+                for (uint32_t i = 0; i < node.nPrimitives; ++i)
+                {
+                    const Primitive& p = primitives[node.primitivesOffset + i];
+                    float tHit = kInfinity;
+                    uint32_t index;
+                    Vector2f uv;
+                    if (p.object->intersectPrimitive(orig, dir, p.index, tHit, index, uv) && tHit < tMax)
+                        return true;
+                }
+                if (toVisitOffset == 0)
+                    break;
+                current = toVisit[--toVisitOffset];
+            }
+            else
+            {
+                toVisit[toVisitOffset++] = node.secondChildOffset;
+                current = current + 1;
+            }
+        }
+        else
+        {
+            if (toVisitOffset == 0)
+                break;
+            current = toVisit[--toVisitOffset];
+        }
+    }
+
+    return false;
+}
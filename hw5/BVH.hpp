@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Bounds3.hpp"
+#include "Object.hpp"
+#include "Vector.hpp"
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+struct hit_payload
+{
+    float tNear;
+    uint32_t index;
+    Vector2f uv;
+    Object* hit_obj;
+};
+
+// Bounding volume hierarchy over the primitives of every object in the scene, so a sphere
+// and the individual triangles of a mesh all live in the same tree. Nodes are stored
+// depth-first in one array: the first child of an interior node directly follows it and
+// the second child sits at secondChildOffset.
+class BVHAccel
+{
+public:
+    explicit BVHAccel(const std::vector<std::unique_ptr<Object> >& objects, int maxPrimsInNode = 4);
+
+    // Closest hit along the ray, if any.
+    std::optional<hit_payload> Intersect(const Vector3f& orig, const Vector3f& dir) const;
+
+    // Any hit closer than tMax. Used for shadow rays, it stops at the first occluder found.
+    bool IntersectP(const Vector3f& orig, const Vector3f& dir, float tMax) const;
+
+    Bounds3 WorldBound() const
+    {
+        return nodes.empty() ? Bounds3() : nodes[0].bounds;
+    }
+
+private:
+    struct Primitive
+    {
+        Object* object;
+        uint32_t index;
+        Bounds3 bounds;
+        Vector3f centroid;
+    };
+
+    struct LinearNode
+    {
+        Bounds3 bounds;
+        union
+        {
+            uint32_t primitivesOffset; // leaf
+            uint32_t secondChildOffset; // interior
+        };
+        uint16_t nPrimitives; // 0 -> interior node
+        uint8_t axis;
+    };
+
+    uint32_t recursiveBuild(uint32_t start, uint32_t end);
+
+    const int maxPrimsInNode;
+    std::vector<Primitive> primitives;
+    std::vector<LinearNode> nodes;
+};
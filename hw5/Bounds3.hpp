@@ -0,0 +1,117 @@
+#pragma once
+
+#include "Vector.hpp"
+
+#include <array>
+#include <limits>
+
+class Bounds3
+{
+public:
+    Bounds3()
+    {
+        float minNum = std::numeric_limits<float>::lowest();
+        float maxNum = std::numeric_limits<float>::max();
+        pMin = Vector3f(maxNum, maxNum, maxNum);
+        pMax = Vector3f(minNum, minNum, minNum);
+    }
+    Bounds3(const Vector3f& p)
+        : pMin(p)
+        , pMax(p)
+    {}
+    Bounds3(const Vector3f& p1, const Vector3f& p2)
+        : pMin(Vector3f::Min(p1, p2))
+        , pMax(Vector3f::Max(p1, p2))
+    {}
+
+    Vector3f Diagonal() const
+    {
+        return pMax - pMin;
+    }
+
+    int maxExtent() const
+    {
+        Vector3f d = Diagonal();
+        if (d.x > d.y && d.x > d.z)
+            return 0;
+        else if (d.y > d.z)
+            return 1;
+        else
+            return 2;
+    }
+
+    float SurfaceArea() const
+    {
+        Vector3f d = Diagonal();
+        return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
+    }
+
+    Vector3f Centroid() const
+    {
+        return 0.5f * pMin + 0.5f * pMax;
+    }
+
+    Vector3f Offset(const Vector3f& p) const
+    {
+        Vector3f o = p - pMin;
+        if (pMax.x > pMin.x)
+            o.x /= pMax.x - pMin.x;
+        if (pMax.y > pMin.y)
+            o.y /= pMax.y - pMin.y;
+        if (pMax.z > pMin.z)
+            o.z /= pMax.z - pMin.z;
+        return o;
+    }
+
+    const Vector3f& operator[](int i) const
+    {
+        return (i == 0) ? pMin : pMax;
+    }
+
+    // Slab test against the segment [0, tMax] of the ray. invDir is the component-wise
+    // reciprocal of the direction and dirIsNeg[i] is 1 when that component is negative,
+    // so the near/far planes can be picked without comparisons. The exit distances are
+    // pushed out by the worst-case rounding error so that grazing hits on the box faces
+    // (e.g. on the border of a flat quad) are never culled.
+    bool IntersectP(const Vector3f& orig, const Vector3f& invDir, const std::array<int, 3>& dirIsNeg,
+                    float tMax) const
+    {
+        constexpr float eps = std::numeric_limits<float>::epsilon() * 0.5f;
+        constexpr float slack = 1 + 2 * (3 * eps) / (1 - 3 * eps);
+
+        const Bounds3& b = *this;
+        float tEnter = (b[dirIsNeg[0]].x - orig.x) * invDir.x;
+        float tExit = (b[1 - dirIsNeg[0]].x - orig.x) * invDir.x * slack;
+        float tyEnter = (b[dirIsNeg[1]].y - orig.y) * invDir.y;
+        float tyExit = (b[1 - dirIsNeg[1]].y - orig.y) * invDir.y * slack;
+        if (tEnter > tyExit || tyEnter > tExit)
+            return false;
+        tEnter = std::max(tEnter, tyEnter);
+        tExit = std::min(tExit, tyExit);
+        float tzEnter = (b[dirIsNeg[2]].z - orig.z) * invDir.z;
+        float tzExit = (b[1 - dirIsNeg[2]].z - orig.z) * invDir.z * slack;
+        if (tEnter > tzExit || tzEnter > tExit)
+            return false;
+        tEnter = std::max(tEnter, tzEnter);
+        tExit = std::min(tExit, tzExit);
+        return tEnter < tMax && tExit > 0;
+    }
+
+    Vector3f pMin, pMax; // two points to specify the bounding box
+};
+
+inline Bounds3 Union(const Bounds3& b1, const Bounds3& b2)
+{
+    Bounds3 ret;
+    ret.pMin = Vector3f::Min(b1.pMin, b2.pMin);
+    ret.pMax = Vector3f::Max(b1.pMax, b2.pMax);
+    return ret;
+}
+
+inline Bounds3 Union(const Bounds3& b, const Vector3f& p)
+{
+    Bounds3 ret;
+    ret.pMin = Vector3f::Min(b.pMin, p);
+    ret.pMax = Vector3f::Max(b.pMax, p);
+    return ret;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <random>
+#include <vector>
+#include "Vector.hpp"
+#include "global.hpp"
+
+struct CameraRay
+{
+    Vector3f orig;
+    Vector3f dir;
+};
+
+// Look-at pinhole / thin-lens camera. The film plane is precomputed as a corner direction plus
+// per-column (du) and per-row (dv) increments, so generating a ray costs two multiply-adds and a
+// normalize instead of redoing the tan/aspect math for every pixel.
+class Camera
+{
+public:
+    // fov is the vertical field of view in degrees. With aperture > 0 the camera becomes a thin
+    // lens of that diameter focused at focusDistance along the view direction.
+    Camera(const Vector3f& position, const Vector3f& target, const Vector3f& up, float fov, int w, int h,
+           float aperture = 0, float focus = 1)
+        : eye(position)
+        , lensRadius(aperture / 2)
+        , focusDistance(focus)
+    {
+        forward = normalize(target - eye);
+        right = normalize(crossProduct(forward, up));
+        upDir = crossProduct(right, forward);
+
+        float scale = std::tan(fov * 0.5f * M_PI / 180.0f);
+        float aspect = w / (float)h;
+        du = right * (2 * aspect * scale / w);
+        dv = upDir * (-2 * scale / h);
+        corner = forward - right * (aspect * scale) + upDir * scale;
+    }
+
+    // Ray through the continuous raster position (px, py); uLens picks the point on the lens.
+    [[nodiscard]] CameraRay generateRay(float px, float py, const Vector2f& uLens = Vector2f(0.5f)) const
+    {
+        return makeRay(corner + du * px + dv * py, uLens);
+    }
+
+    // One sample for every pixel of row y in [x0, x1), appended to rays in pixel order. Sample k of spp
+    // lands in its own cell of a sqrt(spp) x sqrt(spp) grid over the pixel; samples past the last full
+    // grid are uniformly jittered. A single sample per pixel stays on the pixel center.
+    void generateRays(int y, int x0, int x1, int k, int spp, std::mt19937& rng, std::vector<CameraRay>& rays) const
+    {
+        std::uniform_real_distribution<float> dist(0.f, 1.f);
+        int n = std::max(1, (int)std::sqrt((float)spp));
+
+        Vector3f rowBase = corner + dv * (float)y + du * (float)x0;
+        for (int x = x0; x < x1; ++x, rowBase = rowBase + du)
+        {
+            float jx = 0.5f, jy = 0.5f;
+            if (spp > 1)
+            {
+                jx = dist(rng);
+                jy = dist(rng);
+                if (k < n * n)
+                {
+                    jx = (k % n + jx) / n;
+                    jy = (k / n + jy) / n;
+                }
+            }
+            Vector2f uLens(0.5f);
+            if (lensRadius > 0)
+                uLens = Vector2f(dist(rng), dist(rng));
+            rays.push_back(makeRay(rowBase + du * jx + dv * jy, uLens));
+        }
+    }
+
+private:
+    [[nodiscard]] CameraRay makeRay(const Vector3f& filmDir, const Vector2f& uLens) const
+    {
+        if (lensRadius <= 0)
+            return {eye, normalize(filmDir)};
+
+        // filmDir has unit length along forward, so this lands on the plane of focus
+        Vector3f pFocus = eye + filmDir * focusDistance;
+        Vector2f d = concentricSampleDisk(uLens);
+        Vector3f pLens = eye + right * (lensRadius * d.x) + upDir * (lensRadius * d.y);
+        return {pLens, normalize(pFocus - pLens)};
+    }
+
+    // Shirley-Chiu mapping of [0,1]^2 onto the unit disk; keeps the stratification of uLens.
+    static Vector2f concentricSampleDisk(const Vector2f& u)
+    {
+        float ox = 2 * u.x - 1, oy = 2 * u.y - 1;
+        if (ox == 0 && oy == 0)
+            return Vector2f(0);
+        float r, theta;
+        if (std::abs(ox) > std::abs(oy))
+        {
+            r = ox;
+            theta = M_PI / 4 * (oy / ox);
+        }
+        else
+        {
+            r = oy;
+            theta = M_PI / 2 - M_PI / 4 * (ox / oy);
+        }
+        return Vector2f(r * std::cos(theta), r * std::sin(theta));
+    }
+
+    Vector3f eye, forward, right, upDir;
+    Vector3f corner, du, dv;
+    float lensRadius, focusDistance;
+};
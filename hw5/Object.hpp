@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Bounds3.hpp"
 #include "Vector.hpp"
 #include "global.hpp"
 
@@ -22,6 +23,22 @@ public:
     virtual void getSurfaceProperties(const Vector3f&, const Vector3f&, const uint32_t&, const Vector2f&, Vector3f&,
                                       Vector2f&) const = 0;
 
+    // An object is made of getPrimitiveCount() pieces (e.g. the triangles of a mesh) that the
+    // acceleration structure bounds and intersects one at a time. The index reported through
+    // intersectPrimitive() is the one later handed back to getSurfaceProperties().
+    virtual uint32_t getPrimitiveCount() const
+    {
+        return 1;
+    }
+
+    virtual Bounds3 getBounds(uint32_t primitive) const = 0;
+
+    virtual bool intersectPrimitive(const Vector3f& orig, const Vector3f& dir, uint32_t, float& tnear,
+                                    uint32_t& index, Vector2f& uv) const
+    {
+        return intersect(orig, dir, tnear, index, uv);
+    }
+
     virtual Vector3f evalDiffuseColor(const Vector2f&) const
     {
         return diffuseColor;
@@ -1,12 +1,12 @@
+#include <atomic>
 #include <fstream>
+#include <mutex>
+#include <thread>
 #include "Vector.hpp"
 #include "Renderer.hpp"
 #include "Scene.hpp"
 #include <optional>
 
-inline float deg2rad(const float &deg)
-{ return deg * M_PI/180.0; }
-
 // Compute reflection direction
 Vector3f reflect(const Vector3f &I, const Vector3f &N)
 {
@@ -68,43 +68,6 @@ float fresnel(const Vector3f &I, const Vector3f &N, const float &ior)
     // kt = 1 - kr;
 }
 
-// [comment]
-// Returns true if the ray intersects an object, false otherwise.
-//
-// \param orig is the ray origin
-// \param dir is the ray direction
-// \param objects is the list of objects the scene contains
-// \param[out] tNear contains the distance to the cloesest intersected object.
-// \param[out] index stores the index of the intersect triangle if the interesected object is a mesh.
-// \param[out] uv stores the u and v barycentric coordinates of the intersected point
-// \param[out] *hitObject stores the pointer to the intersected object (used to retrieve material information, etc.)
-// \param isShadowRay is it a shadow ray. We can return from the function sooner as soon as we have found a hit.
-// [/comment]
-std::optional<hit_payload> trace(
-        const Vector3f &orig, const Vector3f &dir,
-        const std::vector<std::unique_ptr<Object> > &objects)
-{
-    float tNear = kInfinity;
-    std::optional<hit_payload> payload;
-    for (const auto & object : objects)
-    {
-        float tNearK = kInfinity;
-        uint32_t indexK;
-        Vector2f uvK;
-        if (object->intersect(orig, dir, tNearK, indexK, uvK) && tNearK < tNear)
-        {
-            payload.emplace();
-            payload->hit_obj = object.get();
-            payload->tNear = tNearK;
-            payload->index = indexK;
-            payload->uv = uvK;
-            tNear = tNearK;
-        }
-    }
-
-    return payload;
-}
-
 // [comment]
 // Implementation of the Whitted-style light transport algorithm (E [S*] (D|G) L)
 //
@@ -130,7 +93,7 @@ Vector3f castRay(
     }
 
     Vector3f hitColor = scene.backgroundColor;
-    if (auto payload = trace(orig, dir, scene.get_objects()); payload)
+    if (auto payload = scene.intersect(orig, dir); payload)
     {
         Vector3f hitPoint = orig + dir * payload->tNear;
         Vector3f N; // normal
@@ -184,8 +147,7 @@ Vector3f castRay(
                     lightDir = normalize(lightDir);
                     float LdotN = std::max(0.f, dotProduct(lightDir, N));
                     // is the point in shadow, and is the nearest occluding object closer to the object than the light itself?
-                    auto shadow_res = trace(shadowPointOrig, lightDir, scene.get_objects());
-                    bool inShadow = shadow_res && (shadow_res->tNear * shadow_res->tNear < lightDistance2);
+                    bool inShadow = scene.intersectP(shadowPointOrig, lightDir, std::sqrt(lightDistance2));
 
                     lightAmt += inShadow ? 0 : light->intensity * LdotN;
                     Vector3f reflectionDirection = reflect(-lightDir, N);
@@ -207,44 +169,43 @@ Vector3f castRay(
 // The main render function. This where we iterate over all pixels in the image, generate
 // primary rays and cast these rays into the scene. The content of the framebuffer is
 // saved to a file.
+//
+// Rows are handed out to the worker threads one at a time, so threads that get cheap rows
+// (e.g. only background) simply pick up more of them.
 // [/comment]
-void Renderer::Render(const Scene& scene)
+void Renderer::Render(const Scene& scene, const Camera& camera)
 {
     std::vector<Vector3f> framebuffer(scene.width * scene.height);
 
-    float scale = std::tan(deg2rad(scene.fov * 0.5f));
-    float imageAspectRatio = scene.width / (float)scene.height;
-
-    float depth_z = scene.height / (2 * scale);
+    std::atomic<int> next_row{0};
+    std::mutex progress_mutex;
+    int rows_done = 0;
 
-    // Use this variable as the eye position to start your rays.
-    Vector3f eye_pos(0);
-    int m = 0;
-    for (int j = 0; j < scene.height; ++j)
-    {
-        for (int i = 0; i < scene.width; ++i)
+    auto render_rows = [&]() {
+        std::mt19937 rng(std::random_device{}());
+        std::vector<CameraRay> rays;
+        rays.reserve(scene.width);
+        for (int j = next_row++; j < scene.height; j = next_row++)
         {
-            // generate primary ray direction
-            // float x;
-            // float y;
-            // TODO: Find the x and y positions of the current pixel to get the direction
-            // vector that passes through it.
-            // Also, don't forget to multiply both of them with the variable *scale*, and
-            // x (horizontal) variable with the *imageAspectRatio*   
-
-            float y = -(j - scene.height / 2.0f) / depth_z;
-            float x = (i - scene.width / 2.0f) / depth_z;
-
-            // float x=(2*(float(i)+0.5)/scene.width-1)*scale*imageAspectRatio;
-            // float y=(1-2*(float(j)+0.5)/scene.height)*scale;
-
-
-            Vector3f dir = normalize(Vector3f(x, y, -1)); // Don't forget to normalize this direction!
-
-            framebuffer[m++] = castRay(eye_pos, dir, scene, 0);
+            int m = j * scene.width;
+            for (int k = 0; k < scene.spp; ++k)
+            {
+                rays.clear();
+                camera.generateRays(j, 0, scene.width, k, scene.spp, rng, rays);
+                for (int i = 0; i < scene.width; ++i)
+                    framebuffer[m + i] += castRay(rays[i].orig, rays[i].dir, scene, 0) / scene.spp;
+            }
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            UpdateProgress(++rows_done / (float)scene.height);
         }
-        UpdateProgress(j / (float)scene.height);
-    }
+    };
+
+    int thread_count = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (int t = 0; t < thread_count; ++t)
+        workers.emplace_back(render_rows);
+    for (auto& worker : workers)
+        worker.join();
 
     // save framebuffer to file
     FILE* fp = fopen("binary.ppm", "wb");
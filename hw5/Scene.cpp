@@ -3,3 +3,19 @@
 //
 
 #include "Scene.hpp"
+
+void Scene::buildBVH()
+{
+    printf(" - Generating BVH...\n");
+    bvh = std::make_unique<BVHAccel>(objects);
+}
+
+std::optional<hit_payload> Scene::intersect(const Vector3f& orig, const Vector3f& dir) const
+{
+    return bvh->Intersect(orig, dir);
+}
+
+bool Scene::intersectP(const Vector3f& orig, const Vector3f& dir, float tMax) const
+{
+    return bvh->IntersectP(orig, dir, tMax);
+}
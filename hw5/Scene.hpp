@@ -5,6 +5,7 @@
 #include "Vector.hpp"
 #include "Object.hpp"
 #include "Light.hpp"
+#include "BVH.hpp"
 
 class Scene
 {
@@ -15,6 +16,7 @@ public:
     double fov = 90;
     Vector3f backgroundColor = Vector3f(0.235294, 0.67451, 0.843137);
     int maxDepth = 5;
+    int spp = 1;
     float epsilon = 0.00001;
 
     Scene(int w, int h) : width(w), height(h)
@@ -26,8 +28,14 @@ public:
     [[nodiscard]] const std::vector<std::unique_ptr<Object> >& get_objects() const { return objects; }
     [[nodiscard]] const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
 
+    // Has to be called once every object is added and before rendering.
+    void buildBVH();
+    [[nodiscard]] std::optional<hit_payload> intersect(const Vector3f& orig, const Vector3f& dir) const;
+    [[nodiscard]] bool intersectP(const Vector3f& orig, const Vector3f& dir, float tMax) const;
+
 private:
     // creating the scene (adding objects and lights)
     std::vector<std::unique_ptr<Object> > objects;
     std::vector<std::unique_ptr<Light> > lights;
+    std::unique_ptr<BVHAccel> bvh;
 };
\ No newline at end of file
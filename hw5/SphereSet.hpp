@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Object.hpp"
+#include "../common/SpherePacket.hpp"
+#include "Vector.hpp"
+
+#include <vector>
+
+// A large number of spheres sharing one material, e.g. particles. Instead of one virtual
+// Sphere per particle, the spheres are grouped into packets of eight and every packet is a
+// single primitive of the scene BVH, intersected with one SIMD test.
+//
+// Spheres are grouped in the order they are given, so callers should pass spatially
+// coherent input (sorted along a curve, or the output of a simulation grid) to keep the
+// packet bounds tight.
+class SphereSet : public Object
+{
+public:
+    SphereSet(const std::vector<Vector3f>& c, const std::vector<float>& r)
+        : centers(c)
+        , radii(r)
+    {
+        uint32_t count = centers.size();
+        packets.resize((count + SpherePacket::Width - 1) / SpherePacket::Width);
+        for (uint32_t k = 0; k < packets.size(); ++k)
+        {
+            SpherePacket& p = packets[k];
+            for (int i = 0; i < SpherePacket::Width; ++i)
+            {
+                uint32_t id = std::min(k * SpherePacket::Width + i, count - 1);
+                p.cx[i] = centers[id].x;
+                p.cy[i] = centers[id].y;
+                p.cz[i] = centers[id].z;
+                p.radius2[i] = radii[id] * radii[id];
+                p.id[i] = id;
+            }
+        }
+    }
+
+    bool intersect(const Vector3f& orig, const Vector3f& dir, float& tnear, uint32_t& index, Vector2f&) const override
+    {
+        bool hit = false;
+        for (const auto& p : packets)
+        {
+            float t;
+            uint32_t id;
+            if (intersectSpherePacket(p, orig, dir, 0, tnear, t, id))
+            {
+                tnear = t;
+                index = id;
+                hit = true;
+            }
+        }
+        return hit;
+    }
+
+    uint32_t getPrimitiveCount() const override
+    {
+        return packets.size();
+    }
+
+    Bounds3 getBounds(uint32_t k) const override
+    {
+        Bounds3 bounds;
+        uint32_t end = std::min<uint32_t>((k + 1) * SpherePacket::Width, centers.size());
+        for (uint32_t id = k * SpherePacket::Width; id < end; ++id)
+            bounds = Union(bounds, Bounds3(centers[id] - Vector3f(radii[id]), centers[id] + Vector3f(radii[id])));
+        return bounds;
+    }
+
+    bool intersectPrimitive(const Vector3f& orig, const Vector3f& dir, uint32_t k, float& tnear, uint32_t& index,
+                            Vector2f&) const override
+    {
+        return intersectSpherePacket(packets[k], orig, dir, 0, tnear, tnear, index);
+    }
+
+    void getSurfaceProperties(const Vector3f& P, const Vector3f&, const uint32_t& index, const Vector2f&,
+                              Vector3f& N, Vector2f&) const override
+    {
+        N = normalize(P - centers[index]);
+    }
+
+    std::vector<Vector3f> centers;
+    std::vector<float> radii;
+    std::vector<SpherePacket> packets;
+};
@@ -5,7 +5,7 @@
 #include <cstring>
 #include <memory>
 
-bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, const Vector3f& orig,
+inline bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, const Vector3f& orig,
                           const Vector3f& dir, float& tnear, float& u, float& v)
 {
     // TODO: Implement this function that tests whether the triangle
@@ -72,6 +72,35 @@ public:
         return intersect;
     }
 
+    uint32_t getPrimitiveCount() const override
+    {
+        return numTriangles;
+    }
+
+    Bounds3 getBounds(uint32_t k) const override
+    {
+        const Vector3f& v0 = vertices[vertexIndex[k * 3]];
+        const Vector3f& v1 = vertices[vertexIndex[k * 3 + 1]];
+        const Vector3f& v2 = vertices[vertexIndex[k * 3 + 2]];
+        return Union(Bounds3(v0, v1), v2);
+    }
+
+    bool intersectPrimitive(const Vector3f& orig, const Vector3f& dir, uint32_t k, float& tnear, uint32_t& index,
+                            Vector2f& uv) const override
+    {
+        const Vector3f& v0 = vertices[vertexIndex[k * 3]];
+        const Vector3f& v1 = vertices[vertexIndex[k * 3 + 1]];
+        const Vector3f& v2 = vertices[vertexIndex[k * 3 + 2]];
+        float t, u, v;
+        if (!rayTriangleIntersect(v0, v1, v2, orig, dir, t, u, v))
+            return false;
+        tnear = t;
+        uv.x = u;
+        uv.y = v;
+        index = k;
+        return true;
+    }
+
     void getSurfaceProperties(const Vector3f&, const Vector3f&, const uint32_t& index, const Vector2f& uv, Vector3f& N,
                               Vector2f& st) const override
     {
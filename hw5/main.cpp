@@ -1,5 +1,6 @@
 #include "Scene.hpp"
 #include "Sphere.hpp"
+#include "SphereSet.hpp"
 #include "Triangle.hpp"
 #include "Light.hpp"
 #include "Renderer.hpp"
@@ -22,6 +23,20 @@ int main()
     scene.Add(std::move(sph1));
     scene.Add(std::move(sph2));
 
+    // a bed of small beads on the floor, row by row so that every packet of eight is compact
+    std::vector<Vector3f> centers;
+    std::vector<float> radii;
+    for (int row = 0; row < 12; ++row)
+        for (int col = 0; col < 24; ++col)
+        {
+            centers.emplace_back(-4.6f + col * 0.4f, -2.85f, -6.5f - row * 0.8f);
+            radii.push_back(0.15f);
+        }
+    auto beads = std::make_unique<SphereSet>(centers, radii);
+    beads->materialType = DIFFUSE_AND_GLOSSY;
+    beads->diffuseColor = Vector3f(0.8, 0.3, 0.2);
+    scene.Add(std::move(beads));
+
     Vector3f verts[4] = {{-5,-3,-6}, {5,-3,-6}, {5,-3,-16}, {-5,-3,-16}};
     uint32_t vertIndex[6] = {0, 1, 3, 1, 2, 3};
     Vector2f st[4] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
@@ -30,10 +45,14 @@ int main()
 
     scene.Add(std::move(mesh));
     scene.Add(std::make_unique<Light>(Vector3f(-20, 70, 20), 0.5));
-    scene.Add(std::make_unique<Light>(Vector3f(30, 50, -12), 0.5));    
+    scene.Add(std::make_unique<Light>(Vector3f(30, 50, -12), 0.5));
+
+    scene.buildBVH();
+
+    Camera camera(Vector3f(0), Vector3f(0, 0, -1), Vector3f(0, 1, 0), scene.fov, scene.width, scene.height);
 
     Renderer r;
-    r.Render(scene);
+    r.Render(scene, camera);
 
     return 0;
 }
\ No newline at end of file
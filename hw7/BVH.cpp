@@ -25,9 +25,17 @@ BVHAccel::BVHAccel(std::vector<Object*> p, int maxPrimsInNode,
         hrs, mins, secs);
 }
 
+BVHAccel::~BVHAccel() = default;
+
+static bool sameBounds(const Bounds3& a, const Bounds3& b)
+{
+    return a.pMin.x == b.pMin.x && a.pMin.y == b.pMin.y && a.pMin.z == b.pMin.z && a.pMax.x == b.pMax.x
+           && a.pMax.y == b.pMax.y && a.pMax.z == b.pMax.z;
+}
+
 BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
 {
-    BVHBuildNode* node = new BVHBuildNode();
+    BVHBuildNode* node = arena.Create<BVHBuildNode>();
 
     // Compute bounds of all primitives in BVH node
     Bounds3 bounds;
@@ -35,7 +43,8 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
         bounds = Union(bounds, objects[i]->getBounds());
     if (objects.size() == 1) {
         // Create leaf _BVHBuildNode_
-        node->bounds = objects[0]->getBounds();
+        objects[0]->getMotionBounds(node->bounds, node->boundsEnd);
+        node->moving = !sameBounds(node->bounds, node->boundsEnd);
         node->object = objects[0];
         node->left = nullptr;
         node->right = nullptr;
@@ -47,6 +56,8 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
         node->right = recursiveBuild(std::vector{objects[1]});
 
         node->bounds = Union(node->left->bounds, node->right->bounds);
+        node->boundsEnd = Union(node->left->boundsEnd, node->right->boundsEnd);
+        node->moving = node->left->moving || node->right->moving;
         node->area = node->left->area + node->right->area;
         return node;
     }
@@ -90,6 +101,8 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
         node->right = recursiveBuild(rightshapes);
 
         node->bounds = Union(node->left->bounds, node->right->bounds);
+        node->boundsEnd = Union(node->left->boundsEnd, node->right->boundsEnd);
+        node->moving = node->left->moving || node->right->moving;
         node->area = node->left->area + node->right->area;
     }
 
@@ -105,10 +118,28 @@ Intersection BVHAccel::Intersect(const Ray& ray) const
     return isect;
 }
 
+Bounds3 BVHAccel::WorldBound() const
+{
+    if (!root)
+        return Bounds3();
+    return root->moving ? Union(root->bounds, root->boundsEnd) : root->bounds;
+}
+
+bool BVHAccel::hitNode(const BVHBuildNode* node, const Ray& ray)
+{
+    if (!node->moving)
+        return node->bounds.IntersectP(ray, ray.direction_inv, std::array<int, 3>{ {0, 0, 0} });
+    float t = clamp(0, 1, ray.t);
+    Bounds3 box;
+    box.pMin = lerp(node->bounds.pMin, node->boundsEnd.pMin, t);
+    box.pMax = lerp(node->bounds.pMax, node->boundsEnd.pMax, t);
+    return box.IntersectP(ray, ray.direction_inv, std::array<int, 3>{ {0, 0, 0} });
+}
+
 Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
 {
     // TODO Traverse the BVH to find intersection
-    if (!node->bounds.IntersectP(ray, ray.direction_inv, std::array<int, 3>{ {0, 0, 0} }))
+    if (!hitNode(node, ray))
         return Intersection();
     
     if (node->left && node->right) {
@@ -125,18 +156,19 @@ Intersection BVHAccel::getIntersection(BVHBuildNode* node, const Ray& ray) const
 }
 
 
-void BVHAccel::getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf){
+void BVHAccel::getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf, float v){
     if(node->left == nullptr || node->right == nullptr){
-        node->object->Sample(pos, pdf);
+        float u = std::min(std::max(p / node->area, 0.0f), 0x1.fffffep-1f);
+        node->object->Sample(pos, pdf, Vector2f(u, v));
         pdf *= node->area;
         return;
     }
-    if(p < node->left->area) getSample(node->left, p, pos, pdf);
-    else getSample(node->right, p - node->left->area, pos, pdf);
+    if(p < node->left->area) getSample(node->left, p, pos, pdf, v);
+    else getSample(node->right, p - node->left->area, pos, pdf, v);
 }
 
-void BVHAccel::Sample(Intersection &pos, float &pdf){
-    float p = std::sqrt(get_random_float()) * root->area;
-    getSample(root, p, pos, pdf);
+void BVHAccel::Sample(Intersection &pos, float &pdf, const Vector2f &u){
+    float p = u.x * root->area;
+    getSample(root, p, pos, pdf, u.y);
     pdf /= root->area;
 }
\ No newline at end of file
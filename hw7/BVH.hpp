@@ -14,6 +14,7 @@
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
+#include "MemoryArena.hpp"
 
 struct BVHBuildNode;
 // BVHAccel Forward Declarations
@@ -34,8 +35,9 @@ public:
 
     Intersection Intersect(const Ray &ray) const;
     Intersection getIntersection(BVHBuildNode* node, const Ray& ray)const;
+    static bool hitNode(const BVHBuildNode* node, const Ray& ray);
     bool IntersectP(const Ray &ray) const;
-    BVHBuildNode* root;
+    BVHBuildNode* root = nullptr;
 
     // BVHAccel Private Methods
     BVHBuildNode* recursiveBuild(std::vector<Object*>objects);
@@ -44,13 +46,20 @@ public:
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
     std::vector<Object*> primitives;
+    // owns the nodes, which are freed together with the BVHAccel
+    MemoryArena arena;
 
-    void getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf);
-    void Sample(Intersection &pos, float &pdf);
+    void getSample(BVHBuildNode* node, float p, Intersection &pos, float &pdf, float v);
+    // u.x picks a primitive proportionally to its area and is then rescaled to [0,1) for the
+    // primitive's own Sample
+    void Sample(Intersection &pos, float &pdf, const Vector2f &u);
 };
 
 struct BVHBuildNode {
-    Bounds3 bounds;
+    // bounds at frame time 0; for nodes over moving objects the box at time t is
+    // lerp(bounds, boundsEnd, t)
+    Bounds3 bounds, boundsEnd;
+    bool moving = false;
     BVHBuildNode *left;
     BVHBuildNode *right;
     Object* object;
@@ -6,6 +6,7 @@
 #define RAYTRACING_BOUNDS3_H
 #include "Ray.hpp"
 #include "Vector.hpp"
+#include "global.hpp"
 #include <limits>
 #include <array>
 
@@ -15,16 +16,16 @@ class Bounds3
     Vector3f pMin, pMax; // two points to specify the bounding box
     Bounds3()
     {
-        double minNum = std::numeric_limits<double>::lowest();
-        double maxNum = std::numeric_limits<double>::max();
+        float minNum = std::numeric_limits<float>::lowest();
+        float maxNum = std::numeric_limits<float>::max();
         pMax = Vector3f(minNum, minNum, minNum);
         pMin = Vector3f(maxNum, maxNum, maxNum);
     }
     Bounds3(const Vector3f p) : pMin(p), pMax(p) {}
     Bounds3(const Vector3f p1, const Vector3f p2)
     {
-        pMin = Vector3f(fmin(p1.x, p2.x), fmin(p1.y, p2.y), fmin(p1.z, p2.z));
-        pMax = Vector3f(fmax(p1.x, p2.x), fmax(p1.y, p2.y), fmax(p1.z, p2.z));
+        pMin = Vector3f::Min(p1, p2);
+        pMax = Vector3f::Max(p1, p2);
     }
 
     Vector3f Diagonal() const { return pMax - pMin; }
@@ -39,19 +40,16 @@ class Bounds3
             return 2;
     }
 
-    double SurfaceArea() const
+    float SurfaceArea() const
     {
         Vector3f d = Diagonal();
         return 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
     }
 
-    Vector3f Centroid() { return 0.5 * pMin + 0.5 * pMax; }
+    Vector3f Centroid() { return 0.5f * pMin + 0.5f * pMax; }
     Bounds3 Intersect(const Bounds3& b)
     {
-        return Bounds3(Vector3f(fmax(pMin.x, b.pMin.x), fmax(pMin.y, b.pMin.y),
-                                fmax(pMin.z, b.pMin.z)),
-                       Vector3f(fmin(pMax.x, b.pMax.x), fmin(pMax.y, b.pMax.y),
-                                fmin(pMax.z, b.pMax.z)));
+        return Bounds3(Vector3f::Max(pMin, b.pMin), Vector3f::Min(pMax, b.pMax));
     }
 
     Vector3f Offset(const Vector3f& p) const
@@ -102,7 +100,9 @@ inline bool Bounds3::IntersectP(const Ray& ray, const Vector3f& invDir,
     Vector3f t_max = Vector3f::Max(t1, t2);
     Vector3f t_min = Vector3f::Min(t1, t2);
     float t_in = std::max(t_min.x, std::max(t_min.y, t_min.z));
-    float t_out = std::min(t_max.x, std::min(t_max.y, t_max.z));
+    // the slab distances are rounded; growing t_out by their error bound keeps the test
+    // conservative, so grazing rays never slip between a box and its contents
+    float t_out = std::min(t_max.x, std::min(t_max.y, t_max.z)) * (1 + 2 * roundingGamma(3));
 
     return t_out > 0 && t_in <= t_out;
 }
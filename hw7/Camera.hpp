@@ -0,0 +1,100 @@
+#ifndef RAYTRACING_CAMERA_H
+#define RAYTRACING_CAMERA_H
+
+#include "Ray.hpp"
+#include "Vector.hpp"
+#include "Sampler.hpp"
+#include "global.hpp"
+
+#include <vector>
+
+// Look-at pinhole / thin-lens camera. The film plane is precomputed as a corner direction plus
+// per-column (du) and per-row (dv) increments, so generating a ray costs two multiply-adds and a
+// normalize instead of redoing the tan/aspect math for every pixel.
+class Camera
+{
+public:
+    // fov is the vertical field of view in degrees. With aperture > 0 the camera becomes a thin
+    // lens of that diameter focused at focusDistance along the view direction.
+    Camera(const Vector3f& _eye, const Vector3f& target, const Vector3f& up, float fov, int w, int h,
+           float aperture = 0, float _focusDistance = 1)
+        : eye(_eye), width(w), height(h), lensRadius(aperture / 2), focusDistance(_focusDistance)
+    {
+        forward = normalize(target - eye);
+        right = normalize(crossProduct(forward, up));
+        upDir = crossProduct(right, forward);
+
+        float scale = std::tan(fov * 0.5f * M_PI / 180.0f);
+        float aspect = w / (float)h;
+        du = right * (2 * aspect * scale / w);
+        dv = upDir * (-2 * scale / h);
+        corner = forward - right * (aspect * scale) + upDir * scale;
+    }
+
+    // Ray through the continuous raster position (px, py); uLens picks the point on the lens.
+    Ray generateRay(float px, float py, const Vector2f& uLens = Vector2f(0.5f, 0.5f)) const
+    {
+        return makeRay(corner + du * px + dv * py, uLens);
+    }
+
+    // Sampler dimensions consumed per camera ray (film position, lens position, time); the
+    // integrator continues the path from this dimension.
+    static constexpr int SampleDimensions = 3;
+
+    // Sample k of every pixel of row y in [x0, x1), appended to rays in pixel order. The sub-pixel
+    // offset, the lens position and the time within the shutter interval come from the sampler,
+    // so their stratification over the spp samples of a pixel is whatever the sampler provides.
+    void generateRays(int y, int x0, int x1, int k, Sampler& sampler, std::vector<Ray>& rays) const
+    {
+        Vector3f rowBase = corner + dv * (float)y + du * (float)x0;
+        for (int x = x0; x < x1; ++x, rowBase = rowBase + du) {
+            sampler.startPixel(x, y);
+            sampler.startSample(k);
+            Vector2f uFilm = sampler.get2D(), uLens = sampler.get2D();
+            float uTime = sampler.get1D();
+            rays.push_back(makeRay(rowBase + du * uFilm.x + dv * uFilm.y, uLens));
+            rays.back().t = shutterOpen + (shutterClose - shutterOpen) * uTime;
+        }
+    }
+
+    Vector3f eye, forward, right, upDir;
+    int width, height;
+    float lensRadius, focusDistance;
+    // rays are spread uniformly over [shutterOpen, shutterClose] of the frame time [0, 1], which
+    // is what moving objects are animated over; equal values give no motion blur
+    float shutterOpen = 0, shutterClose = 0;
+
+private:
+    Ray makeRay(const Vector3f& filmDir, const Vector2f& uLens) const
+    {
+        if (lensRadius <= 0)
+            return Ray(eye, normalize(filmDir));
+
+        // filmDir has unit length along forward, so this lands on the plane of focus
+        Vector3f pFocus = eye + filmDir * focusDistance;
+        Vector2f d = concentricSampleDisk(uLens);
+        Vector3f pLens = eye + right * (lensRadius * d.x) + upDir * (lensRadius * d.y);
+        return Ray(pLens, normalize(pFocus - pLens));
+    }
+
+    // Shirley-Chiu mapping of [0,1]^2 onto the unit disk; keeps the stratification of uLens.
+    static Vector2f concentricSampleDisk(const Vector2f& u)
+    {
+        float ox = 2 * u.x - 1, oy = 2 * u.y - 1;
+        if (ox == 0 && oy == 0)
+            return Vector2f(0, 0);
+        float r, theta;
+        if (std::abs(ox) > std::abs(oy)) {
+            r = ox;
+            theta = M_PI / 4 * (oy / ox);
+        } else {
+            r = oy;
+            theta = M_PI / 2 - M_PI / 4 * (ox / oy);
+        }
+        return Vector2f(r * std::cos(theta), r * std::sin(theta));
+    }
+
+    Vector3f corner, du, dv;
+};
+
+#endif //RAYTRACING_CAMERA_H
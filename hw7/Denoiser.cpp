@@ -0,0 +1,120 @@
+#include "Denoiser.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+const float kEps = 1e-4f;
+
+inline float luminance(const Vector3f& c) { return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; }
+
+inline float dist2(const Vector3f& a, const Vector3f& b)
+{
+    Vector3f d = a - b;
+    return dotProduct(d, d);
+}
+
+inline Vector3f demodulate(const Vector3f& c, const Vector3f& albedo)
+{
+    return Vector3f(c.x / std::max(albedo.x, kEps), c.y / std::max(albedo.y, kEps), c.z / std::max(albedo.z, kEps));
+}
+
+}
+
+std::vector<Vector3f> Denoiser::Denoise(const std::vector<Vector3f>& color, const AOVBuffers& aov, int width,
+                                        int height) const
+{
+    // demodulate: filter illumination, not albedo
+    std::vector<Vector3f> a(color.size()), b(color.size());
+    std::vector<float> varA(color.size()), varB(color.size());
+    for (size_t i = 0; i < color.size(); ++i) {
+        a[i] = demodulate(color[i], aov.albedo[i]);
+        float l = std::max(luminance(aov.albedo[i]), kEps);
+        varA[i] = aov.variance[i] / (l * l);
+    }
+
+    const int TILE = 32;
+    int tilesX = (width + TILE - 1) / TILE, tilesY = (height + TILE - 1) / TILE;
+    int thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int it = 0; it < iterations; ++it) {
+        int step = 1 << it;
+        std::atomic<int> next_tile{0};
+        auto work = [&]() {
+            for (int t = next_tile++; t < tilesX * tilesY; t = next_tile++) {
+                int x0 = (t % tilesX) * TILE, y0 = (t / tilesX) * TILE;
+                Pass(a, varA, b, varB, aov, width, height, step, x0, y0, std::min(x0 + TILE, width),
+                     std::min(y0 + TILE, height));
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int i = 0; i < thread_count; ++i)
+            workers.emplace_back(work);
+        for (auto& worker : workers)
+            worker.join();
+        std::swap(a, b);
+        std::swap(varA, varB);
+    }
+
+    for (size_t i = 0; i < color.size(); ++i) {
+        const Vector3f& al = aov.albedo[i];
+        a[i] = a[i] * Vector3f(std::max(al.x, kEps), std::max(al.y, kEps), std::max(al.z, kEps));
+    }
+    return a;
+}
+
+void Denoiser::Pass(const std::vector<Vector3f>& in, const std::vector<float>& varIn, std::vector<Vector3f>& out,
+                    std::vector<float>& varOut, const AOVBuffers& aov, int width, int height, int step, int x0,
+                    int y0, int x1, int y1) const
+{
+    static const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            int p = y * width + x;
+            const Vector3f& cp = in[p];
+            const Vector3f& np = aov.normal[p];
+            const Vector3f& ap = aov.albedo[p];
+            float dp = aov.depth[p];
+            float lp = luminance(cp);
+            float invSigmaL = 1.0f / (sigmaLuminance * std::sqrt(varIn[p]) + kEps);
+
+            Vector3f sum(0.0f);
+            float wsum = 0, varSum = 0;
+            for (int dy = -2; dy <= 2; ++dy) {
+                int qy = y + dy * step;
+                if (qy < 0 || qy >= height)
+                    continue;
+                for (int dx = -2; dx <= 2; ++dx) {
+                    int qx = x + dx * step;
+                    if (qx < 0 || qx >= width)
+                        continue;
+                    int q = qy * width + qx;
+                    const Vector3f& cq = in[q];
+
+                    float tapDistance = step * std::sqrt(float(dx * dx + dy * dy));
+                    float cosN = std::max(0.0f, dotProduct(np, aov.normal[q]));
+                    float wn = std::pow(cosN, sigmaNormal);
+                    float e = std::abs(lp - luminance(cq)) * invSigmaL
+                              + std::abs(dp - aov.depth[q]) / (sigmaDepth * tapDistance * dp + kEps)
+                              + dist2(ap, aov.albedo[q]) / (sigmaAlbedo * sigmaAlbedo);
+                    float w = kernel[dx + 2] * kernel[dy + 2] * wn * std::exp(-e);
+
+                    sum += cq * w;
+                    varSum += w * w * varIn[q];
+                    wsum += w;
+                }
+            }
+            // the center tap always has weight > 0 unless its normal is degenerate
+            if (wsum > 0) {
+                out[p] = sum / wsum;
+                varOut[p] = varSum / (wsum * wsum);
+            } else {
+                out[p] = cp;
+                varOut[p] = varIn[p];
+            }
+        }
+    }
+}
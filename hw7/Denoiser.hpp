@@ -0,0 +1,52 @@
+#ifndef RAYTRACING_DENOISER_H
+#define RAYTRACING_DENOISER_H
+
+#include "Vector.hpp"
+
+#include <vector>
+
+// First-hit features of one camera ray; depth 0 means the ray missed.
+struct AOVSample
+{
+    Vector3f albedo;
+    Vector3f normal;
+    float depth = 0;
+};
+
+// AOVSamples averaged over the samples of each pixel, plus the estimated variance of the
+// pixel's mean luminance.
+struct AOVBuffers
+{
+    AOVBuffers(int w, int h) : albedo(w * h), normal(w * h), depth(w * h, 0.0f), variance(w * h, 0.0f) {}
+
+    std::vector<Vector3f> albedo;
+    std::vector<Vector3f> normal;
+    std::vector<float> depth;
+    std::vector<float> variance;
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al., HPG 2010) guided by the AOVs.
+// The radiance is divided by the albedo before filtering and multiplied back afterwards, so
+// texture and material edges survive and only the lighting is smoothed. Each pass spreads a
+// 5x5 B3-spline kernel over taps 2^i pixels apart, with edge-stopping weights on the
+// illumination (scaled by its estimated standard deviation, which is filtered along with it as
+// in SVGF), normal, relative depth and albedo. Passes run in parallel over tiles.
+class Denoiser
+{
+public:
+    int iterations = 5;
+    float sigmaLuminance = 4.0f;  // in standard deviations of the center pixel
+    float sigmaNormal = 64.0f;    // exponent on the normal cosine
+    float sigmaDepth = 0.02f;     // relative depth difference per pixel of tap distance
+    float sigmaAlbedo = 0.1f;
+
+    std::vector<Vector3f> Denoise(const std::vector<Vector3f>& color, const AOVBuffers& aov, int width,
+                                  int height) const;
+
+private:
+    void Pass(const std::vector<Vector3f>& in, const std::vector<float>& varIn, std::vector<Vector3f>& out,
+              std::vector<float>& varOut, const AOVBuffers& aov, int width, int height, int step, int x0, int y0,
+              int x1, int y1) const;
+};
+
+#endif //RAYTRACING_DENOISER_H
@@ -0,0 +1,80 @@
+#ifndef RAYTRACING_DISTRIBUTION_H
+#define RAYTRACING_DISTRIBUTION_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "Vector.hpp"
+
+// Piecewise-constant 1D distribution over [0,1) with n equal-width buckets of weight func[i].
+struct Distribution1D
+{
+    Distribution1D(const float* f, int n) : func(f, f + n), cdf(n + 1)
+    {
+        cdf[0] = 0;
+        for (int i = 1; i <= n; ++i)
+            cdf[i] = cdf[i - 1] + func[i - 1] / n;
+        funcInt = cdf[n];
+        for (int i = 1; i <= n; ++i)
+            cdf[i] = funcInt == 0 ? float(i) / n : cdf[i] / funcInt;
+    }
+
+    int Count() const { return (int)func.size(); }
+
+    // maps u to x distributed like func; pdf is the density of x, offset the bucket it lies in
+    float SampleContinuous(float u, float& pdf, int& offset) const
+    {
+        offset = int(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) - 1;
+        offset = std::min(std::max(offset, 0), Count() - 1);
+        float du = u - cdf[offset];
+        if (cdf[offset + 1] - cdf[offset] > 0)
+            du /= cdf[offset + 1] - cdf[offset];
+        pdf = funcInt > 0 ? func[offset] / funcInt : 0;
+        return std::min((offset + du) / Count(), 0x1.fffffep-1f);
+    }
+
+    std::vector<float> func, cdf;
+    float funcInt;
+};
+
+// Piecewise-constant 2D distribution over [0,1)^2 from an nu x nv grid stored row by row:
+// a marginal over rows (v) and one conditional per row (u).
+class Distribution2D
+{
+public:
+    Distribution2D(const float* func, int nu, int nv)
+    {
+        conditional.reserve(nv);
+        for (int v = 0; v < nv; ++v)
+            conditional.emplace_back(&func[v * nu], nu);
+        std::vector<float> marginalFunc(nv);
+        for (int v = 0; v < nv; ++v)
+            marginalFunc[v] = conditional[v].funcInt;
+        marginal = std::make_unique<Distribution1D>(marginalFunc.data(), nv);
+    }
+
+    Vector2f SampleContinuous(const Vector2f& u, float& pdf) const
+    {
+        float pdfs[2];
+        int v;
+        float d1 = marginal->SampleContinuous(u.y, pdfs[1], v);
+        int iu;
+        float d0 = conditional[v].SampleContinuous(u.x, pdfs[0], iu);
+        pdf = pdfs[0] * pdfs[1];
+        return Vector2f(d0, d1);
+    }
+
+    float Pdf(const Vector2f& p) const
+    {
+        int iu = std::min(std::max(int(p.x * conditional[0].Count()), 0), conditional[0].Count() - 1);
+        int iv = std::min(std::max(int(p.y * marginal->Count()), 0), marginal->Count() - 1);
+        return marginal->funcInt > 0 ? conditional[iv].func[iu] / marginal->funcInt : 0;
+    }
+
+private:
+    std::vector<Distribution1D> conditional;
+    std::unique_ptr<Distribution1D> marginal;
+};
+
+#endif //RAYTRACING_DISTRIBUTION_H
@@ -0,0 +1,180 @@
+#include "EnvironmentLight.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "global.hpp"
+
+namespace {
+
+// PF (RGB) or Pf (grey) portable float map; rows are stored bottom to top
+void loadPFM(std::ifstream& in, const std::string& filename, int& width, int& height, std::vector<Vector3f>& pixels)
+{
+    std::string magic;
+    float scale;
+    in >> magic >> width >> height >> scale;
+    in.get();
+    if ((magic != "PF" && magic != "Pf") || width <= 0 || height <= 0)
+        throw std::runtime_error("bad PFM header in " + filename);
+    int channels = magic == "PF" ? 3 : 1;
+    bool swap = scale > 0; // positive scale means big-endian data
+
+    std::vector<float> data((size_t)width * height * channels);
+    in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+    if (!in)
+        throw std::runtime_error("truncated PFM data in " + filename);
+    if (swap) {
+        for (auto& f : data) {
+            uint32_t v;
+            std::memcpy(&v, &f, 4);
+            v = (v >> 24) | ((v >> 8) & 0xff00u) | ((v << 8) & 0xff0000u) | (v << 24);
+            std::memcpy(&f, &v, 4);
+        }
+    }
+
+    pixels.resize((size_t)width * height);
+    for (int y = 0; y < height; ++y) {
+        const float* row = &data[(size_t)(height - 1 - y) * width * channels];
+        for (int x = 0; x < width; ++x) {
+            const float* p = row + x * channels;
+            pixels[y * width + x] = channels == 3 ? Vector3f(p[0], p[1], p[2]) : Vector3f(p[0]);
+        }
+    }
+}
+
+// Radiance RGBE, flat or with the run-length encoded scanlines most tools write
+void loadHDR(std::ifstream& in, const std::string& filename, int& width, int& height, std::vector<Vector3f>& pixels)
+{
+    std::string line;
+    bool rgbe = false;
+    while (std::getline(in, line) && !line.empty()) {
+        if (line.rfind("FORMAT=", 0) == 0)
+            rgbe = line == "FORMAT=32-bit_rle_rgbe";
+    }
+    std::getline(in, line);
+    std::istringstream resolution(line);
+    std::string ySign, xSign;
+    resolution >> ySign >> height >> xSign >> width;
+    if (!rgbe || ySign != "-Y" || xSign != "+X" || width <= 0 || height <= 0)
+        throw std::runtime_error("unsupported Radiance header in " + filename);
+
+    pixels.resize((size_t)width * height);
+    std::vector<uint8_t> scanline((size_t)width * 4);
+    // a byte of the RLE data, which must not end inside a run
+    auto next = [&]() {
+        int byte = in.get();
+        if (byte == EOF)
+            throw std::runtime_error("truncated Radiance data in " + filename);
+        return byte;
+    };
+    for (int y = 0; y < height; ++y) {
+        uint8_t head[4];
+        in.read(reinterpret_cast<char*>(head), 4);
+        if (!in)
+            throw std::runtime_error("truncated Radiance data in " + filename);
+        if (head[0] == 2 && head[1] == 2 && ((head[2] << 8) | head[3]) == width && width >= 8 && width < 32768) {
+            // new-style RLE: the four components are stored one after the other
+            for (int c = 0; c < 4; ++c) {
+                for (int x = 0; x < width;) {
+                    int count = next();
+                    if (count > 128) {
+                        count -= 128;
+                        int value = next();
+                        if (count > width - x)
+                            throw std::runtime_error("bad RLE run in " + filename);
+                        for (int i = 0; i < count; ++i)
+                            scanline[(x++) * 4 + c] = (uint8_t)value;
+                    } else {
+                        if (count == 0 || count > width - x)
+                            throw std::runtime_error("bad RLE run in " + filename);
+                        for (int i = 0; i < count; ++i)
+                            scanline[(x++) * 4 + c] = (uint8_t)next();
+                    }
+                }
+            }
+        } else {
+            std::memcpy(scanline.data(), head, 4);
+            in.read(reinterpret_cast<char*>(scanline.data() + 4), (width - 1) * 4);
+        }
+        if (!in)
+            throw std::runtime_error("truncated Radiance data in " + filename);
+
+        for (int x = 0; x < width; ++x) {
+            const uint8_t* p = &scanline[x * 4];
+            float f = p[3] ? std::ldexp(1.0f, p[3] - (128 + 8)) : 0;
+            pixels[y * width + x] = p[3] ? Vector3f((p[0] + 0.5f) * f, (p[1] + 0.5f) * f, (p[2] + 0.5f) * f)
+                                         : Vector3f(0.0f);
+        }
+    }
+}
+
+inline float luminance(const Vector3f& c) { return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; }
+
+}
+
+EnvironmentLight::EnvironmentLight(const std::string& filename, float scale)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("cannot open environment map " + filename);
+    if (in.peek() == 'P')
+        loadPFM(in, filename, width, height, pixels);
+    else
+        loadHDR(in, filename, width, height, pixels);
+    for (auto& p : pixels)
+        p = p * scale;
+
+    // weight each texel by the solid angle it covers; the small epsilon keeps every direction
+    // sampleable so MIS never meets a zero light pdf on a lit direction
+    std::vector<float> func((size_t)width * height);
+    for (int y = 0; y < height; ++y) {
+        float sinTheta = std::sin(M_PI * (y + 0.5f) / height);
+        for (int x = 0; x < width; ++x)
+            func[y * width + x] = (luminance(pixels[y * width + x]) + 1e-4f) * sinTheta;
+    }
+    distribution = std::make_unique<Distribution2D>(func.data(), width, height);
+}
+
+const Vector3f& EnvironmentLight::texel(const Vector2f& uv) const
+{
+    int x = std::min(std::max(int(uv.x * width), 0), width - 1);
+    int y = std::min(std::max(int(uv.y * height), 0), height - 1);
+    return pixels[y * width + x];
+}
+
+static Vector2f directionToUV(const Vector3f& dir)
+{
+    float theta = std::acos(clamp(-1, 1, dir.y));
+    float phi = std::atan2(dir.z, dir.x);
+    if (phi < 0)
+        phi += 2 * M_PI;
+    return Vector2f(phi / (2 * M_PI), theta / M_PI);
+}
+
+Vector3f EnvironmentLight::Le(const Vector3f& dir) const
+{
+    return texel(directionToUV(dir));
+}
+
+Vector3f EnvironmentLight::Sample(const Vector2f& u, Vector3f& wi, float& pdf) const
+{
+    float mapPdf;
+    Vector2f uv = distribution->SampleContinuous(u, mapPdf);
+    float theta = uv.y * M_PI, phi = uv.x * 2 * M_PI;
+    float sinTheta = std::sin(theta);
+    wi = Vector3f(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+    // (u, v) -> solid angle: d omega = 2 pi^2 sin(theta) du dv
+    pdf = sinTheta > 0 ? mapPdf / (2 * M_PI * M_PI * sinTheta) : 0;
+    return texel(uv);
+}
+
+float EnvironmentLight::Pdf(const Vector3f& wi) const
+{
+    Vector2f uv = directionToUV(wi);
+    float sinTheta = std::sin(uv.y * M_PI);
+    return sinTheta > 0 ? distribution->Pdf(uv) / (2 * M_PI * M_PI * sinTheta) : 0;
+}
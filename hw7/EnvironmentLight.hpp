@@ -0,0 +1,35 @@
+#ifndef RAYTRACING_ENVIRONMENTLIGHT_H
+#define RAYTRACING_ENVIRONMENTLIGHT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Distribution.hpp"
+#include "Vector.hpp"
+
+// Infinitely far light from an equirectangular (latitude-longitude) float image, loaded from
+// a PFM or Radiance .hdr file. The top row is +y; u = 0 looks along +x and u grows towards +z.
+// Directions are importance sampled from a 2D distribution of pixel luminance * sin(theta),
+// so bright regions like the sun get the samples they need.
+class EnvironmentLight
+{
+public:
+    explicit EnvironmentLight(const std::string& filename, float scale = 1.0f);
+
+    // radiance arriving along -dir, i.e. seen when looking in direction dir
+    Vector3f Le(const Vector3f& dir) const;
+    // picks a direction wi towards the environment; pdf is per solid angle
+    Vector3f Sample(const Vector2f& u, Vector3f& wi, float& pdf) const;
+    float Pdf(const Vector3f& wi) const;
+
+    int width = 0, height = 0;
+
+private:
+    const Vector3f& texel(const Vector2f& uv) const;
+
+    std::vector<Vector3f> pixels;
+    std::unique_ptr<Distribution2D> distribution;
+};
+
+#endif //RAYTRACING_ENVIRONMENTLIGHT_H
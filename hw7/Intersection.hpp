@@ -15,7 +15,7 @@ struct Intersection
         happened=false;
         coords=Vector3f();
         normal=Vector3f();
-        distance= std::numeric_limits<double>::max();
+        distance= std::numeric_limits<float>::max();
         obj =nullptr;
         m=nullptr;
     }
@@ -24,7 +24,7 @@ struct Intersection
     Vector3f tcoords;
     Vector3f normal;
     Vector3f emit;
-    double distance;
+    float distance;
     Object* obj;
     Material* m;
 };
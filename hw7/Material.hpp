@@ -7,7 +7,21 @@
 
 #include "Vector.hpp"
 
-enum MaterialType { DIFFUSE};
+// DIFFUSE:    Lambertian with albedo Kd
+// MIRROR:     perfect specular reflection tinted by Ks
+// CONDUCTOR:  GGX microfacet reflection, Schlick Fresnel with F0 = Ks
+// DIELECTRIC: GGX microfacet reflection and refraction with index ior (smooth if roughness ~ 0)
+enum MaterialType { DIFFUSE, MIRROR, CONDUCTOR, DIELECTRIC };
+
+// Result of Material::sampleBSDF. For delta lobes f and pdf carry the same Dirac factor, so
+// f * |cos| / pdf is still the throughput weight, but f can't be evaluated for other directions.
+struct BSDFSample
+{
+    Vector3f wi;
+    Vector3f f;
+    float pdf = 0;
+    bool delta = false;
+};
 
 class Material{
 private:
@@ -71,27 +85,109 @@ private:
         // kt = 1 - kr;
     }
 
-    Vector3f toWorld(const Vector3f &a, const Vector3f &N){
-        Vector3f B, C;
-        if (std::fabs(N.x) > std::fabs(N.y)){
-            float invLen = 1.0f / std::sqrt(N.x * N.x + N.z * N.z);
-            C = Vector3f(N.z * invLen, 0.0f, -N.x *invLen);
-        }
-        else {
-            float invLen = 1.0f / std::sqrt(N.y * N.y + N.z * N.z);
-            C = Vector3f(0.0f, N.z * invLen, -N.y *invLen);
+    // Orthonormal shading frame around N, built once per call of the fused functions below.
+    struct Frame
+    {
+        Vector3f s, t, n;
+        explicit Frame(const Vector3f &N) : n(N) {
+            if (std::fabs(N.x) > std::fabs(N.y)){
+                float invLen = 1.0f / std::sqrt(N.x * N.x + N.z * N.z);
+                t = Vector3f(N.z * invLen, 0.0f, -N.x *invLen);
+            }
+            else {
+                float invLen = 1.0f / std::sqrt(N.y * N.y + N.z * N.z);
+                t = Vector3f(0.0f, N.z * invLen, -N.y *invLen);
+            }
+            s = crossProduct(t, N);
         }
-        B = crossProduct(C, N);
-        return a.x * B + a.y * C + a.z * N;
+        Vector3f toLocal(const Vector3f &v) const { return Vector3f(dotProduct(v, s), dotProduct(v, t), dotProduct(v, n)); }
+        Vector3f toWorld(const Vector3f &v) const { return v.x * s + v.y * t + v.z * n; }
+    };
+
+    Vector3f toWorld(const Vector3f &a, const Vector3f &N){
+        return Frame(N).toWorld(a);
+    }
+
+    // Below, directions are in the local frame (z = N) and point away from the surface.
+    static bool sameHemisphere(const Vector3f &a, const Vector3f &b) { return a.z * b.z > 0; }
+
+    // unpolarized Fresnel reflectance of a dielectric interface, cosi < 0 means from inside
+    static float frDielectric(float cosi, float eta) {
+        cosi = clamp(-1, 1, cosi);
+        if (cosi < 0) { eta = 1 / eta; cosi = -cosi; }
+        float sin2t = (1 - cosi * cosi) / (eta * eta);
+        if (sin2t >= 1) return 1;
+        float cost = std::sqrt(std::max(0.0f, 1 - sin2t));
+        float rParl = (eta * cosi - cost) / (eta * cosi + cost);
+        float rPerp = (cosi - eta * cost) / (cosi + eta * cost);
+        return (rParl * rParl + rPerp * rPerp) / 2;
+    }
+
+    static Vector3f frSchlick(const Vector3f &F0, float cosi) {
+        float m = std::pow(1 - clamp(0, 1, std::fabs(cosi)), 5.0f);
+        return F0 + (Vector3f(1.0f) - F0) * m;
     }
 
+    // refracts w about n (same side as w or not); etap receives the relative index used
+    static bool refractLocal(const Vector3f &w, Vector3f n, float eta, float &etap, Vector3f &wt) {
+        float cosi = dotProduct(n, w);
+        if (cosi < 0) { eta = 1 / eta; cosi = -cosi; n = -n; }
+        float sin2t = std::max(0.0f, 1 - cosi * cosi) / (eta * eta);
+        if (sin2t >= 1) return false;
+        float cost = std::sqrt(1 - sin2t);
+        wt = -w / eta + (cosi / eta - cost) * n;
+        etap = eta;
+        return true;
+    }
+
+    // Trowbridge-Reitz (GGX) microfacet distribution with alpha = roughness
+    float ggxD(const Vector3f &wm) const {
+        float cos2 = wm.z * wm.z;
+        if (cos2 <= 0) return 0;
+        float tan2 = (1 - cos2) / cos2;
+        float a2 = roughness * roughness;
+        float e = 1 + tan2 / a2;
+        return 1 / (M_PI * a2 * cos2 * cos2 * e * e);
+    }
+    float ggxLambda(const Vector3f &w) const {
+        float cos2 = w.z * w.z;
+        if (cos2 <= 0) return 0;
+        float tan2 = (1 - cos2) / cos2;
+        return (std::sqrt(1 + roughness * roughness * tan2) - 1) / 2;
+    }
+    float ggxG1(const Vector3f &w) const { return 1 / (1 + ggxLambda(w)); }
+    float ggxG(const Vector3f &wo, const Vector3f &wi) const { return 1 / (1 + ggxLambda(wo) + ggxLambda(wi)); }
+    // density of visible normals seen from wo
+    float ggxPdf(const Vector3f &wo, const Vector3f &wm) const {
+        return ggxG1(wo) / std::fabs(wo.z) * ggxD(wm) * std::fabs(dotProduct(wo, wm));
+    }
+    // samples a visible normal (Heitz 2018)
+    Vector3f ggxSampleWm(const Vector3f &wo, const Vector2f &u) const {
+        Vector3f wh = normalize(Vector3f(roughness * wo.x, roughness * wo.y, wo.z));
+        if (wh.z < 0) wh = -wh;
+        Vector3f T1 = wh.z < 0.99999f ? normalize(crossProduct(Vector3f(0, 0, 1), wh)) : Vector3f(1, 0, 0);
+        Vector3f T2 = crossProduct(wh, T1);
+        float r = std::sqrt(u.x), phi = 2 * M_PI * u.y;
+        float px = r * std::cos(phi), py = r * std::sin(phi);
+        float h = std::sqrt(1 - px * px);
+        float t = (1 + wh.z) / 2;
+        py = (1 - t) * h + t * py;
+        float pz = std::sqrt(std::max(0.0f, 1 - px * px - py * py));
+        Vector3f nh = px * T1 + py * T2 + pz * wh;
+        return normalize(Vector3f(roughness * nh.x, roughness * nh.y, std::max(1e-6f, nh.z)));
+    }
+
+    inline bool sampleLocal(const Vector3f &wo, const Vector2f &u, float uLobe, BSDFSample &bs) const;
+    inline Vector3f evalLocal(const Vector3f &wo, const Vector3f &wi, float &pdf) const;
+
 public:
     MaterialType m_type;
     //Vector3f m_color;
     Vector3f m_emission;
-    float ior;
-    Vector3f Kd, Ks;
+    float ior = 1.5f;
+    Vector3f Kd, Ks = Vector3f(1.0f);
     float specularExponent;
+    float roughness = 0;  // GGX alpha of CONDUCTOR and DIELECTRIC; below ~1e-3 they are treated as smooth
     //Texture tex;
 
     inline Material(MaterialType t=DIFFUSE, Vector3f e=Vector3f(0,0,0));
@@ -101,8 +197,22 @@ public:
     inline Vector3f getEmission();
     inline bool hasEmission();
 
-    // sample a ray by Material properties
-    inline Vector3f sample(const Vector3f &wi, const Vector3f &N);
+    // only delta lobes: light sampling can't contribute at this vertex
+    inline bool isDelta() const;
+    // surfaces may be hit from behind (refraction), so triangles must not cull back faces
+    inline bool isTwoSided() const { return m_type == DIELECTRIC; }
+
+    // Fused sampling: picks wi for the outgoing direction wo (both pointing away from the hit),
+    // and returns f(wi, wo), the pdf of wi and whether the lobe is a delta, sharing the frame and
+    // the Fresnel / microfacet terms. u is a 2D sample and uLobe picks between reflection and
+    // transmission. Returns false if no direction was produced.
+    inline bool sampleBSDF(const Vector3f &wo, const Vector3f &N, const Vector2f &u, float uLobe, BSDFSample &bs) const;
+    // f(wi, wo) and the pdf sampleBSDF would have for wi, evaluated together; 0 for delta lobes
+    inline Vector3f evalBSDF(const Vector3f &wi, const Vector3f &wo, const Vector3f &N, float &pdf) const;
+
+    // Unfused forms kept for existing callers; each builds its own frame.
+    // sample a ray by Material properties, u is a 2D sample in [0,1)^2
+    inline Vector3f sample(const Vector3f &wi, const Vector3f &N, const Vector2f &u);
     // given a ray, calculate the PdF of this ray
     inline float pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N);
     // given a ray, calculate the contribution of this ray
@@ -128,52 +238,187 @@ Vector3f Material::getColorAt(double u, double v) {
     return Vector3f();
 }
 
-
-Vector3f Material::sample(const Vector3f &wi, const Vector3f &N){
+bool Material::isDelta() const {
     switch(m_type){
-        case DIFFUSE:
-        {
-            // uniform sample on the hemisphere
-            float x_1 = get_random_float(), x_2 = get_random_float();
-            float z = std::fabs(1.0f - 2.0f * x_1);
-            float r = std::sqrt(1.0f - z * z), phi = 2 * M_PI * x_2;
-            Vector3f localRay(r*std::cos(phi), r*std::sin(phi), z);
-            return toWorld(localRay, N);
-            
-            break;
-        }
+        case MIRROR:
+            return true;
+        case CONDUCTOR:
+        case DIELECTRIC:
+            return roughness < 1e-3f;
+        default:
+            return false;
     }
 }
 
-float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+bool Material::sampleBSDF(const Vector3f &wo, const Vector3f &N, const Vector2f &u, float uLobe, BSDFSample &bs) const {
+    Frame frame(N);
+    if (!sampleLocal(frame.toLocal(wo), u, uLobe, bs))
+        return false;
+    bs.wi = normalize(frame.toWorld(bs.wi));
+    return true;
+}
+
+Vector3f Material::evalBSDF(const Vector3f &wi, const Vector3f &wo, const Vector3f &N, float &pdf) const {
+    Frame frame(N);
+    return evalLocal(frame.toLocal(wo), frame.toLocal(wi), pdf);
+}
+
+bool Material::sampleLocal(const Vector3f &wo, const Vector2f &u, float uLobe, BSDFSample &bs) const {
+    if (wo.z == 0)
+        return false;
     switch(m_type){
         case DIFFUSE:
         {
-            // uniform sample probability 1 / (2 * PI)
-            if (dotProduct(wo, N) > 0.0f)
-                return 0.5f / M_PI;
-            else
-                return 0.0f;
-            break;
+            // cosine-weighted hemisphere on the side of wo
+            float r = std::sqrt(u.x), phi = 2 * M_PI * u.y;
+            float z = std::sqrt(std::max(0.0f, 1 - u.x));
+            bs.wi = Vector3f(r * std::cos(phi), r * std::sin(phi), wo.z > 0 ? z : -z);
+            bs.pdf = z / M_PI;
+            bs.f = Kd / M_PI;
+            bs.delta = false;
+            return bs.pdf > 0;
+        }
+        case MIRROR:
+        {
+            bs.wi = Vector3f(-wo.x, -wo.y, wo.z);
+            bs.f = Ks / std::fabs(wo.z);
+            bs.pdf = 1;
+            bs.delta = true;
+            return true;
+        }
+        case CONDUCTOR:
+        {
+            if (isDelta()) {
+                bs.wi = Vector3f(-wo.x, -wo.y, wo.z);
+                bs.f = frSchlick(Ks, wo.z) / std::fabs(wo.z);
+                bs.pdf = 1;
+                bs.delta = true;
+                return true;
+            }
+            Vector3f wm = ggxSampleWm(wo, u);
+            bs.wi = -wo + 2 * dotProduct(wo, wm) * wm;
+            if (!sameHemisphere(wo, bs.wi))
+                return false;
+            float cosO = std::fabs(wo.z), cosI = std::fabs(bs.wi.z), cosOm = std::fabs(dotProduct(wo, wm));
+            bs.pdf = ggxPdf(wo, wm) / (4 * cosOm);
+            bs.f = frSchlick(Ks, cosOm) * (ggxD(wm) * ggxG(wo, bs.wi) / (4 * cosI * cosO));
+            bs.delta = false;
+            return bs.pdf > 0;
+        }
+        case DIELECTRIC:
+        {
+            if (isDelta()) {
+                float R = frDielectric(wo.z, ior), T = 1 - R;
+                if (uLobe < R) {
+                    bs.wi = Vector3f(-wo.x, -wo.y, wo.z);
+                    bs.f = Vector3f(R / std::fabs(wo.z));
+                    bs.pdf = R;
+                } else {
+                    float etap;
+                    if (!refractLocal(wo, Vector3f(0, 0, 1), ior, etap, bs.wi))
+                        return false;
+                    // radiance is scaled by 1/eta^2 when crossing the interface
+                    bs.f = Vector3f(T / std::fabs(bs.wi.z) / (etap * etap));
+                    bs.pdf = T;
+                }
+                bs.delta = true;
+                return bs.pdf > 0;
+            }
+            Vector3f wm = ggxSampleWm(wo, u);
+            float R = frDielectric(dotProduct(wo, wm), ior), T = 1 - R;
+            float cosO = std::fabs(wo.z);
+            if (uLobe < R) {
+                bs.wi = -wo + 2 * dotProduct(wo, wm) * wm;
+                if (!sameHemisphere(wo, bs.wi))
+                    return false;
+                bs.pdf = ggxPdf(wo, wm) / (4 * std::fabs(dotProduct(wo, wm))) * R;
+                bs.f = Vector3f(ggxD(wm) * ggxG(wo, bs.wi) * R / (4 * std::fabs(bs.wi.z) * cosO));
+            } else {
+                float etap;
+                if (!refractLocal(wo, wm, ior, etap, bs.wi) || sameHemisphere(wo, bs.wi) || bs.wi.z == 0)
+                    return false;
+                float iDotM = dotProduct(bs.wi, wm), oDotM = dotProduct(wo, wm);
+                float denom = (iDotM + oDotM / etap) * (iDotM + oDotM / etap);
+                bs.pdf = ggxPdf(wo, wm) * std::fabs(iDotM) / denom * T;
+                bs.f = Vector3f(T * ggxD(wm) * ggxG(wo, bs.wi)
+                                * std::fabs(iDotM * oDotM / (bs.wi.z * wo.z * denom)) / (etap * etap));
+            }
+            bs.delta = false;
+            return bs.pdf > 0;
         }
     }
+    return false;
 }
 
-Vector3f Material::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+Vector3f Material::evalLocal(const Vector3f &wo, const Vector3f &wi, float &pdf) const {
+    pdf = 0;
+    if (isDelta() || wo.z == 0 || wi.z == 0)
+        return Vector3f(0.0f);
     switch(m_type){
         case DIFFUSE:
         {
-            // calculate the contribution of diffuse   model
-            float cosalpha = dotProduct(N, wo);
-            if (cosalpha > 0.0f) {
-                Vector3f diffuse = Kd / M_PI;
-                return diffuse;
-            }
-            else
+            if (!sameHemisphere(wo, wi))
                 return Vector3f(0.0f);
-            break;
+            pdf = std::fabs(wi.z) / M_PI;
+            return Kd / M_PI;
         }
+        case CONDUCTOR:
+        {
+            if (!sameHemisphere(wo, wi))
+                return Vector3f(0.0f);
+            Vector3f wm = wi + wo;
+            if (dotProduct(wm, wm) == 0)
+                return Vector3f(0.0f);
+            wm = normalize(wm);
+            if (wm.z < 0) wm = -wm;
+            float cosOm = std::fabs(dotProduct(wo, wm));
+            pdf = ggxPdf(wo, wm) / (4 * cosOm);
+            return frSchlick(Ks, cosOm) * (ggxD(wm) * ggxG(wo, wi) / (4 * std::fabs(wi.z) * std::fabs(wo.z)));
+        }
+        case DIELECTRIC:
+        {
+            bool reflect = sameHemisphere(wo, wi);
+            float etap = reflect ? 1 : (wo.z > 0 ? ior : 1 / ior);
+            Vector3f wm = wi * etap + wo;
+            if (dotProduct(wm, wm) == 0)
+                return Vector3f(0.0f);
+            wm = normalize(wm);
+            if (wm.z < 0) wm = -wm;
+            float iDotM = dotProduct(wi, wm), oDotM = dotProduct(wo, wm);
+            // microfacets facing away from either direction don't contribute
+            if (iDotM * wi.z < 0 || oDotM * wo.z < 0)
+                return Vector3f(0.0f);
+            float R = frDielectric(oDotM, ior), T = 1 - R;
+            if (reflect) {
+                pdf = ggxPdf(wo, wm) / (4 * std::fabs(oDotM)) * R;
+                return Vector3f(ggxD(wm) * ggxG(wo, wi) * R / std::fabs(4 * wi.z * wo.z));
+            }
+            float denom = (iDotM + oDotM / etap) * (iDotM + oDotM / etap);
+            pdf = ggxPdf(wo, wm) * std::fabs(iDotM) / denom * T;
+            return Vector3f(T * ggxD(wm) * ggxG(wo, wi) * std::fabs(iDotM * oDotM / (wi.z * wo.z * denom))
+                            / (etap * etap));
+        }
+        default:
+            return Vector3f(0.0f);
     }
 }
 
+Vector3f Material::sample(const Vector3f &wi, const Vector3f &N, const Vector2f &u){
+    BSDFSample bs;
+    if (!sampleBSDF(wi, N, u, 0.5f, bs))
+        return Vector3f(0.0f);
+    return bs.wi;
+}
+
+float Material::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+    float p;
+    evalBSDF(wi, wo, N, p);
+    return p;
+}
+
+Vector3f Material::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+    float p;
+    return evalBSDF(wi, wo, N, p);
+}
+
 #endif //RAYTRACING_MATERIAL_H
@@ -0,0 +1,114 @@
+#ifndef RAYTRACING_MEMORYARENA_H
+#define RAYTRACING_MEMORYARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Monotonic allocator: objects are carved one after another out of large cache-line aligned
+// blocks and are only released all at once, by Reset() or the destructor. Allocation is a
+// pointer bump, and things built together (BVH nodes, a mesh's triangles) end up next to each
+// other in memory. Destructors are never run, so only put objects here whose destructor has
+// nothing to release. Not thread safe; give each thread or build its own arena.
+class MemoryArena
+{
+public:
+    static constexpr size_t Alignment = 64;
+
+    explicit MemoryArena(size_t blockSize = 256 * 1024) : blockSize(blockSize) {}
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+
+    ~MemoryArena()
+    {
+        for (auto& block : used)
+            release(block.first);
+        for (auto& block : available)
+            release(block.first);
+        if (current)
+            release(current);
+    }
+
+    // uninitialized storage for bytes bytes, aligned to 16 (or to align, up to Alignment)
+    void* Alloc(size_t bytes, size_t align = 16)
+    {
+        size_t offset = (currentPos + align - 1) & ~(align - 1);
+        if (!current || offset + bytes > currentSize) {
+            if (current)
+                used.emplace_back(current, currentSize);
+            // reuse a released block that is large enough before asking for a new one
+            auto it = std::find_if(available.begin(), available.end(),
+                                   [&](const std::pair<char*, size_t>& b) { return b.second >= bytes; });
+            if (it != available.end()) {
+                current = it->first;
+                currentSize = it->second;
+                available.erase(it);
+            } else {
+                currentSize = std::max(bytes, blockSize);
+                current = static_cast<char*>(::operator new(currentSize, std::align_val_t(Alignment)));
+            }
+            offset = 0;
+        }
+        currentPos = offset + bytes;
+        return current + offset;
+    }
+
+    // n default-constructed Ts
+    template <typename T>
+    T* Alloc(size_t n = 1)
+    {
+        static_assert(alignof(T) <= Alignment, "over-aligned type");
+        T* p = static_cast<T*>(Alloc(n * sizeof(T), std::max(alignof(T), size_t(16))));
+        for (size_t i = 0; i < n; ++i)
+            new (&p[i]) T();
+        return p;
+    }
+
+    // storage for n Ts, to be constructed with placement new
+    template <typename T>
+    T* AllocArray(size_t n)
+    {
+        static_assert(alignof(T) <= Alignment, "over-aligned type");
+        return static_cast<T*>(Alloc(n * sizeof(T), std::max(alignof(T), size_t(16))));
+    }
+
+    // one T constructed from args
+    template <typename T, typename... Args>
+    T* Create(Args&&... args)
+    {
+        static_assert(alignof(T) <= Alignment, "over-aligned type");
+        return new (Alloc(sizeof(T), std::max(alignof(T), size_t(16)))) T(std::forward<Args>(args)...);
+    }
+
+    // drops every allocation but keeps the blocks for reuse
+    void Reset()
+    {
+        currentPos = 0;
+        for (auto& block : used)
+            available.push_back(block);
+        used.clear();
+    }
+
+    size_t TotalAllocated() const
+    {
+        size_t total = current ? currentSize : 0;
+        for (auto& block : used)
+            total += block.second;
+        for (auto& block : available)
+            total += block.second;
+        return total;
+    }
+
+private:
+    static void release(char* block) { ::operator delete(block, std::align_val_t(Alignment)); }
+
+    const size_t blockSize;
+    char* current = nullptr;
+    size_t currentSize = 0, currentPos = 0;
+    std::vector<std::pair<char*, size_t>> used, available;
+};
+
+#endif //RAYTRACING_MEMORYARENA_H
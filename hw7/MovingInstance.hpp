@@ -0,0 +1,135 @@
+#ifndef RAYTRACING_MOVINGINSTANCE_H
+#define RAYTRACING_MOVINGINSTANCE_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "Object.hpp"
+#include "Transform.hpp"
+
+// An object placed by an AnimatedTransform. Rays are moved into the prototype's space with the
+// transform at ray.t, so the prototype (a mesh with its own BVH, a sphere, ...) is built once in
+// object space and never rebuilt. The BVH sees motion bounds: the boxes at t = 0 and t = 1,
+// widened so that their interpolation covers the object at every time in between.
+//
+// Instances are not sampled as area lights (hasEmit() is false, as light sampling has no ray
+// time); an emissive instance is still seen by BSDF-sampled rays.
+class MovingInstance : public Object
+{
+public:
+    MovingInstance(std::unique_ptr<Object> _prototype, const AnimatedTransform& _motion)
+        : prototype(std::move(_prototype)), motion(_motion)
+    {
+        computeMotionBounds();
+    }
+
+    bool intersect(const Ray& ray) override { return getIntersection(ray).happened; }
+
+    bool intersect(const Ray& ray, float& tnear, uint32_t& index) const override
+    {
+        Transform toObject = motion.at(clamp(0, 1, ray.t)).inverse();
+        return prototype->intersect(Ray(toObject.point(ray.origin), toObject.vector(ray.direction), ray.t), tnear,
+                                    index);
+    }
+
+    Intersection getIntersection(Ray ray) override
+    {
+        Transform toWorld = motion.at(clamp(0, 1, ray.t));
+        Transform toObject = toWorld.inverse();
+        // the object-space direction is not renormalized, so the hit distance stays in world units
+        Intersection hit = prototype->getIntersection(
+            Ray(toObject.point(ray.origin), toObject.vector(ray.direction), ray.t));
+        if (hit.happened) {
+            hit.coords = toWorld.point(hit.coords);
+            hit.normal = normalize(toObject.normal(hit.normal));
+            hit.obj = this;
+        }
+        return hit;
+    }
+
+    void getSurfaceProperties(const Vector3f& P, const Vector3f& I, const uint32_t& index, const Vector2f& uv,
+                              Vector3f& N, Vector2f& st) const override
+    {
+        prototype->getSurfaceProperties(P, I, index, uv, N, st);
+    }
+
+    Vector3f evalDiffuseColor(const Vector2f& st) const override { return prototype->evalDiffuseColor(st); }
+
+    Bounds3 getBounds() override { return Union(start, end); }
+    void getMotionBounds(Bounds3& _start, Bounds3& _end) override
+    {
+        _start = start;
+        _end = end;
+    }
+
+    // the prototype's area; exact while the motion has no scaling
+    float getArea() override { return prototype->getArea(); }
+
+    // a point on the object at t = 0
+    void Sample(Intersection& pos, float& pdf, const Vector2f& u) override
+    {
+        prototype->Sample(pos, pdf, u);
+        Transform toWorld = motion.at(0);
+        pos.coords = toWorld.point(pos.coords);
+        pos.normal = normalize(toWorld.inverse().normal(pos.normal));
+    }
+
+    bool hasEmit() override { return false; }
+
+    std::unique_ptr<Object> prototype;
+    AnimatedTransform motion;
+
+private:
+    // Boxes of the moving object are taken at Steps + 1 times. For each face of the box, the line
+    // through the face positions at t = 0 and t = 1 is shifted outwards until it clears every
+    // sample, plus 0.5% of the swept box size: a point turning by at most a full revolution over the
+    // frame strays less than that from the chord between two neighbouring samples.
+    void computeMotionBounds()
+    {
+        const int Steps = 32;
+        Bounds3 local = prototype->getBounds();
+        std::vector<Bounds3> boxes(Steps + 1);
+        for (int i = 0; i <= Steps; ++i) {
+            Transform toWorld = motion.at(float(i) / Steps);
+            Bounds3 box;
+            for (int c = 0; c < 8; ++c) {
+                Vector3f corner((c & 1) ? local.pMax.x : local.pMin.x, (c & 2) ? local.pMax.y : local.pMin.y,
+                                (c & 4) ? local.pMax.z : local.pMin.z);
+                box = Union(box, toWorld.point(corner));
+            }
+            boxes[i] = box;
+        }
+        start = boxes[0];
+        end = boxes[Steps];
+        if (!motion.isAnimated())
+            return;
+
+        Bounds3 swept;
+        for (auto& box : boxes)
+            swept = Union(swept, box);
+        float slack = 0.005f * swept.Diagonal().norm();
+        // x, y, z are laid out contiguously, as Vector3f::operator[] assumes
+        float* startMin = &start.pMin.x, * startMax = &start.pMax.x;
+        float* endMin = &end.pMin.x, * endMax = &end.pMax.x;
+        for (int axis = 0; axis < 3; ++axis) {
+            float lowShift = 0, highShift = 0;
+            for (int i = 0; i <= Steps; ++i) {
+                float t = float(i) / Steps;
+                float low = (1 - t) * startMin[axis] + t * endMin[axis];
+                float high = (1 - t) * startMax[axis] + t * endMax[axis];
+                lowShift = std::max(lowShift, low - (&boxes[i].pMin.x)[axis]);
+                highShift = std::max(highShift, (&boxes[i].pMax.x)[axis] - high);
+            }
+            float padLow = lowShift + slack, padHigh = highShift + slack;
+            startMin[axis] -= padLow;
+            endMin[axis] -= padLow;
+            startMax[axis] += padHigh;
+            endMax[axis] += padHigh;
+        }
+    }
+
+    Bounds3 start, end;
+};
+
+#endif //RAYTRACING_MOVINGINSTANCE_H
@@ -22,8 +22,12 @@ public:
     virtual void getSurfaceProperties(const Vector3f &, const Vector3f &, const uint32_t &, const Vector2f &, Vector3f &, Vector2f &) const = 0;
     virtual Vector3f evalDiffuseColor(const Vector2f &) const =0;
     virtual Bounds3 getBounds()=0;
+    // boxes at frame times 0 and 1 whose linear interpolation contains the object at every time
+    // in between; getBounds() must contain both. Static objects return getBounds() twice.
+    virtual void getMotionBounds(Bounds3 &start, Bounds3 &end) { start = end = getBounds(); }
     virtual float getArea()=0;
-    virtual void Sample(Intersection &pos, float &pdf)=0;
+    // u is a 2D sample in [0,1)^2 mapped onto the surface; pdf is with respect to area
+    virtual void Sample(Intersection &pos, float &pdf, const Vector2f &u)=0;
     virtual bool hasEmit()=0;
 };
 
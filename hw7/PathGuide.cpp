@@ -0,0 +1,230 @@
+#include "PathGuide.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "global.hpp"
+
+namespace {
+
+void atomicAdd(std::atomic<float>& target, float value)
+{
+    float current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+        ;
+}
+
+float clampUnit(float v) { return std::min(std::max(v, 0.0f), 0x1.fffffep-1f); }
+
+// (cos theta, phi) scaled to [0,1)^2; equal areas map to equal solid angles
+Vector2f toSquare(const Vector3f& d)
+{
+    float phi = std::atan2(d.y, d.x);
+    if (phi < 0)
+        phi += 2 * M_PI;
+    return Vector2f(clampUnit((d.z + 1) * 0.5f), clampUnit(phi * (0.5f / M_PI)));
+}
+
+Vector3f fromSquare(const Vector2f& p)
+{
+    float cosTheta = 2 * p.x - 1, phi = 2 * M_PI * p.y;
+    float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta * cosTheta));
+    return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+}
+
+void DirectionalTree::record(Vector2f p, float value)
+{
+    samples.fetch_add(1, std::memory_order_relaxed);
+    if (!(value > 0) || !std::isfinite(value))
+        return;
+    uint32_t i = 0;
+    for (;;) {
+        int qx = p.x >= 0.5f, qy = p.y >= 0.5f, q = qx + 2 * qy;
+        atomicAdd(nodes[i].sum[q], value);
+        if (!nodes[i].child[q])
+            return;
+        i = nodes[i].child[q];
+        p = Vector2f(2 * p.x - qx, 2 * p.y - qy);
+    }
+}
+
+float DirectionalTree::total() const { return nodes[0].total(); }
+
+float DirectionalTree::pdf(Vector2f p) const
+{
+    float density = 1;
+    uint32_t i = 0;
+    for (;;) {
+        const Node& n = nodes[i];
+        float t = n.total();
+        int qx = p.x >= 0.5f, qy = p.y >= 0.5f, q = qx + 2 * qy;
+        if (t <= 0)
+            return 0;
+        density *= 4 * n.sum[q].load(std::memory_order_relaxed) / t;
+        if (!n.child[q] || density == 0)
+            return density;
+        i = n.child[q];
+        p = Vector2f(2 * p.x - qx, 2 * p.y - qy);
+    }
+}
+
+// picks the column by its share of the node's radiance with u.x, then the quadrant within the
+// column with u.y, reusing both (rescaled) further down
+Vector2f DirectionalTree::sample(Vector2f u) const
+{
+    Vector2f origin(0, 0);
+    float size = 1;
+    uint32_t i = 0;
+    for (;;) {
+        const Node& n = nodes[i];
+        float s[4];
+        for (int q = 0; q < 4; ++q)
+            s[q] = n.sum[q].load(std::memory_order_relaxed);
+        float t = s[0] + s[1] + s[2] + s[3], left = s[0] + s[2];
+
+        int qx;
+        if (u.x * t < left) {
+            qx = 0;
+            u.x = clampUnit(u.x * t / left);
+        } else {
+            qx = 1;
+            u.x = clampUnit((u.x * t - left) / std::max(t - left, 1e-30f));
+        }
+        float low = s[qx], column = s[qx] + s[qx + 2];
+        int qy;
+        if (u.y * column < low) {
+            qy = 0;
+            u.y = clampUnit(u.y * column / low);
+        } else {
+            qy = 1;
+            u.y = clampUnit((u.y * column - low) / std::max(column - low, 1e-30f));
+        }
+
+        size *= 0.5f;
+        origin = Vector2f(origin.x + qx * size, origin.y + qy * size);
+        int q = qx + 2 * qy;
+        if (!n.child[q])
+            return Vector2f(clampUnit(origin.x + u.x * size), clampUnit(origin.y + u.y * size));
+        i = n.child[q];
+    }
+}
+
+void DirectionalTree::refine(const DirectionalTree& previous, float threshold, int maxDepth)
+{
+    nodes.assign(1, Node());
+    samples = 0;
+    float total = previous.total();
+    if (total <= 0)
+        return;
+
+    // a node of the new tree, the matching node of the previous one (or -1 below its leaves)
+    // and the fraction of the radiance in each of its quadrants
+    struct Item
+    {
+        uint32_t node;
+        int old;
+        float fraction[4];
+        int depth;
+    };
+    Item root{0, 0, {}, 1};
+    for (int q = 0; q < 4; ++q)
+        root.fraction[q] = previous.nodes[0].sum[q].load(std::memory_order_relaxed) / total;
+    std::vector<Item> stack{root};
+    while (!stack.empty()) {
+        Item item = stack.back();
+        stack.pop_back();
+        if (item.depth >= maxDepth)
+            continue;
+        for (int q = 0; q < 4; ++q) {
+            if (item.fraction[q] <= threshold)
+                continue;
+            Item child{uint32_t(nodes.size()), -1, {}, item.depth + 1};
+            if (item.old >= 0 && previous.nodes[item.old].child[q])
+                child.old = previous.nodes[item.old].child[q];
+            for (int c = 0; c < 4; ++c)
+                child.fraction[c] = child.old >= 0
+                                    ? previous.nodes[child.old].sum[c].load(std::memory_order_relaxed) / total
+                                    : item.fraction[q] / 4;
+            nodes[item.node].child[q] = child.node;
+            nodes.emplace_back();
+            stack.push_back(child);
+        }
+    }
+}
+
+PathGuide::PathGuide(const Bounds3& bounds) : nodes(1), leaves(1)
+{
+    origin = bounds.pMin;
+    Vector3f d = bounds.Diagonal();
+    extent = Vector3f(std::max(d.x, 1e-4f), std::max(d.y, 1e-4f), std::max(d.z, 1e-4f));
+}
+
+uint32_t PathGuide::leafIndex(const Vector3f& p) const
+{
+    Vector3f x = (p - origin) / extent;
+    float c[3] = {clampUnit(x.x), clampUnit(x.y), clampUnit(x.z)};
+    uint32_t i = 0;
+    while (nodes[i].children[0]) {
+        int a = nodes[i].axis;
+        int side = c[a] >= 0.5f;
+        c[a] = 2 * c[a] - side;
+        i = nodes[i].children[side];
+    }
+    return nodes[i].leaf;
+}
+
+const DirectionalTree* PathGuide::lookup(const Vector3f& p) const
+{
+    const DirectionalTree& tree = leaves[leafIndex(p)].sampling;
+    return tree.total() > 0 ? &tree : nullptr;
+}
+
+void PathGuide::record(const Vector3f& p, const Vector3f& wi, float radiance)
+{
+    if (training)
+        leaves[leafIndex(p)].building.record(toSquare(wi), radiance);
+}
+
+float PathGuide::pdf(const DirectionalTree& tree, const Vector3f& wi)
+{
+    return tree.pdf(toSquare(wi)) / (4 * M_PI);
+}
+
+Vector3f PathGuide::sample(const DirectionalTree& tree, const Vector2f& u)
+{
+    return fromSquare(tree.sample(u));
+}
+
+void PathGuide::refine(int passSamples)
+{
+    // split crowded leaves in half, each half taking a copy of the statistics; children are
+    // appended, so this loop visits them too and keeps splitting while they are still crowded
+    uint32_t threshold = uint32_t(spatialThreshold * std::sqrt(float(passSamples)));
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].children[0])
+            continue;
+        uint32_t leaf = nodes[i].leaf;
+        uint32_t samples = leaves[leaf].building.samples.load();
+        if (samples <= threshold)
+            continue;
+        leaves[leaf].building.samples = samples / 2;
+        leaves.push_back(leaves[leaf]);
+
+        SpatialNode low, high;
+        low.axis = high.axis = (nodes[i].axis + 1) % 3;
+        low.leaf = leaf;
+        high.leaf = uint32_t(leaves.size() - 1);
+        nodes[i].children[0] = uint32_t(nodes.size());
+        nodes[i].children[1] = uint32_t(nodes.size() + 1);
+        nodes.push_back(low);
+        nodes.push_back(high);
+    }
+
+    // the next pass samples what this one learned and learns into trees shaped by it
+    for (auto& leaf : leaves) {
+        leaf.sampling = leaf.building;
+        leaf.building.refine(leaf.sampling, directionalThreshold, 20);
+    }
+}
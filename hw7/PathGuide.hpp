@@ -0,0 +1,128 @@
+#ifndef RAYTRACING_PATHGUIDE_H
+#define RAYTRACING_PATHGUIDE_H
+
+#include "Bounds3.hpp"
+#include "Vector.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Quadtree over the square [0,1)^2 of directions (cylindrical coordinates, so areas in the
+// square are proportional to solid angle). Every node stores the radiance recorded in each of its
+// four quadrants, summed over the whole subtree; a child index of 0 means the quadrant is a leaf.
+// record() may run on many threads at once: the sums are atomics and the structure is not changed.
+class DirectionalTree
+{
+public:
+    DirectionalTree() : nodes(1) {}
+
+    void record(Vector2f p, float value);
+    // density on [0,1)^2 of sample(); only meaningful when total() > 0
+    float pdf(Vector2f p) const;
+    Vector2f sample(Vector2f u) const;
+    float total() const;
+
+    // Builds this tree from the statistics of previous: quadrants holding more than threshold of
+    // the total radiance are split, the others merged, down to maxDepth. The sums start at zero.
+    void refine(const DirectionalTree& previous, float threshold, int maxDepth);
+
+    std::atomic<uint32_t> samples{0};
+
+    DirectionalTree(const DirectionalTree& t) : samples(t.samples.load()), nodes(t.nodes) {}
+    DirectionalTree& operator=(const DirectionalTree& t)
+    {
+        samples = t.samples.load();
+        nodes = t.nodes;
+        return *this;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<float> sum[4];
+        uint32_t child[4] = {0, 0, 0, 0};
+
+        Node()
+        {
+            for (auto& s : sum)
+                s.store(0, std::memory_order_relaxed);
+        }
+        Node(const Node& n) { *this = n; }
+        Node& operator=(const Node& n)
+        {
+            for (int i = 0; i < 4; ++i) {
+                sum[i].store(n.sum[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                child[i] = n.child[i];
+            }
+            return *this;
+        }
+        float total() const
+        {
+            return sum[0].load(std::memory_order_relaxed) + sum[1].load(std::memory_order_relaxed) +
+                   sum[2].load(std::memory_order_relaxed) + sum[3].load(std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<Node> nodes;
+};
+
+// Path guiding with an SD-tree (Müller et al., "Practical Path Guiding for Efficient
+// Light-Transport Simulation", 2017): a binary tree over the scene bounds, split alternately in x,
+// y and z, whose leaves each hold a DirectionalTree of the radiance arriving there.
+//
+// The image is rendered in passes of 1, 2, 4, ... samples per pixel. During a pass the
+// integrator guides bounces with the distributions learned by the previous pass (sampling trees,
+// read only) and records the radiance its paths actually carried into the building trees, with
+// lock-free atomic updates. Between passes, refine() splits the spatial leaves that received many
+// records and adapts every directional tree to what it learned. The recorded values are Monte
+// Carlo estimates (radiance over the pdf of the direction), taken after Russian roulette, so a path
+// that survived roulette counts with its full reweighted throughput.
+class PathGuide
+{
+public:
+    explicit PathGuide(const Bounds3& bounds);
+
+    // the directional distribution to sample at p, or nullptr when the previous pass learned
+    // nothing there
+    const DirectionalTree* lookup(const Vector3f& p) const;
+    // wi points away from p; radiance is the incident luminance divided by the pdf of wi
+    void record(const Vector3f& p, const Vector3f& wi, float radiance);
+
+    // solid angle pdf of the direction, and a direction drawn with that pdf
+    static float pdf(const DirectionalTree& tree, const Vector3f& wi);
+    static Vector3f sample(const DirectionalTree& tree, const Vector2f& u);
+
+    // call between passes, with no pass running; passSamples is the spp of the finished pass
+    void refine(int passSamples);
+
+    // records are dropped unless this is set, e.g. in the last pass, whose statistics nobody reads
+    bool training = true;
+    // probability of sampling the BSDF rather than the guide at a guided vertex
+    float bsdfFraction = 0.5f;
+    // a spatial leaf splits after 12000 * sqrt(passSamples) records
+    float spatialThreshold = 12000;
+    // a directional quadrant splits when it holds more than this fraction of the leaf's radiance
+    float directionalThreshold = 0.01f;
+
+private:
+    struct SpatialNode
+    {
+        // children[0] == 0 marks a leaf, whose trees are in leaves[leaf]
+        uint32_t children[2] = {0, 0};
+        uint32_t leaf = 0;
+        uint8_t axis = 0;
+    };
+    struct Leaf
+    {
+        DirectionalTree sampling, building;
+    };
+
+    uint32_t leafIndex(const Vector3f& p) const;
+
+    Vector3f origin, extent;
+    std::vector<SpatialNode> nodes;
+    std::vector<Leaf> leaves;
+};
+
+#endif //RAYTRACING_PATHGUIDE_H
@@ -0,0 +1,152 @@
+#include "RenderServer.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "Renderer.hpp"
+
+namespace {
+
+Vector3f parseVector(const std::string& key, const std::string& value)
+{
+    std::istringstream in(value);
+    float x, y, z;
+    char c1, c2;
+    if (!(in >> x >> c1 >> y >> c2 >> z) || c1 != ',' || c2 != ',')
+        throw std::runtime_error("bad vector for " + key + ": " + value);
+    return Vector3f(x, y, z);
+}
+
+template <typename T>
+T parseNumber(const std::string& key, const std::string& value)
+{
+    std::istringstream in(value);
+    T number;
+    if (!(in >> number) || !in.eof())
+        throw std::runtime_error("bad number for " + key + ": " + value);
+    return number;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+RenderServer::RenderServer(SceneDescription description)
+{
+    Resident(std::move(description));
+}
+
+void RenderServer::Resident(SceneDescription description)
+{
+    resident = std::move(description);
+    const Scene& scene = *resident.scene;
+    defaults = Defaults{scene.width, scene.height, scene.spp, scene.denoise, scene.output};
+}
+
+void RenderServer::Run(std::istream& in, FILE* out)
+{
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty())
+            continue;
+        bool keepGoing;
+        try {
+            keepGoing = Handle(line, out);
+        } catch (const std::exception& e) {
+            std::fprintf(out, "error %s\n", e.what());
+            keepGoing = true;
+        }
+        std::fflush(out);
+        if (!keepGoing)
+            break;
+    }
+}
+
+bool RenderServer::Handle(const std::string& line, FILE* out)
+{
+    std::istringstream request(line);
+    std::string command;
+    request >> command;
+    if (command == "render") {
+        Render(request, out);
+    } else if (command == "load") {
+        std::string path;
+        if (!(request >> path))
+            throw std::runtime_error("load needs a scene file");
+        Load(path, out);
+    } else if (command == "quit") {
+        std::fprintf(out, "ok\n");
+        return false;
+    } else {
+        throw std::runtime_error("unknown request " + command);
+    }
+    return true;
+}
+
+void RenderServer::Render(std::istream& arguments, FILE* out)
+{
+    Scene& scene = *resident.scene;
+    CameraParameters view = resident.view;
+    int width = defaults.width, height = defaults.height, spp = defaults.spp;
+    bool denoise = defaults.denoise;
+    std::string output = defaults.output;
+
+    std::string argument;
+    while (arguments >> argument) {
+        size_t eq = argument.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error("expected key=value, got " + argument);
+        std::string key = argument.substr(0, eq), value = argument.substr(eq + 1);
+        if (key == "output") output = value;
+        else if (key == "spp") spp = parseNumber<int>(key, value);
+        else if (key == "width") width = parseNumber<int>(key, value);
+        else if (key == "height") height = parseNumber<int>(key, value);
+        else if (key == "denoise") denoise = parseNumber<int>(key, value) != 0;
+        else if (key == "eye") view.eye = parseVector(key, value);
+        else if (key == "target") view.target = parseVector(key, value);
+        else if (key == "up") view.up = parseVector(key, value);
+        else if (key == "fov") view.fov = parseNumber<float>(key, value);
+        else if (key == "aperture") view.aperture = parseNumber<float>(key, value);
+        else if (key == "focus") view.focus = parseNumber<float>(key, value);
+        else throw std::runtime_error("unknown render setting " + key);
+    }
+    if (spp <= 0 || width <= 0 || height <= 0)
+        throw std::runtime_error("spp, width and height must be positive");
+    // fail before rendering, without truncating an image already there: appending leaves an existing
+    // file as it is, and a file created only for the check is removed again
+    bool existed = access(output.c_str(), F_OK) == 0;
+    if (!std::ofstream(output, std::ios::binary | std::ios::app))
+        throw std::runtime_error("cannot write " + output);
+    if (!existed)
+        std::remove(output.c_str());
+
+    // every job sets all of these, starting from the defaults, so nothing leaks between jobs
+    scene.width = width;
+    scene.height = height;
+    scene.spp = spp;
+    scene.denoise = denoise;
+    scene.output = output;
+    scene.fov = view.fov;
+    std::unique_ptr<Camera> camera = view.build(width, height);
+
+    auto start = std::chrono::steady_clock::now();
+    Renderer r;
+    r.Render(scene, *camera);
+    std::fprintf(out, "ok %s %.3f\n", output.c_str(), secondsSince(start));
+}
+
+void RenderServer::Load(const std::string& path, FILE* out)
+{
+    auto start = std::chrono::steady_clock::now();
+    // the old scene stays resident if the new one fails to load
+    SceneDescription description = loadScene(path);
+    description.scene->buildBVH();
+    Resident(std::move(description));
+    std::fprintf(out, "ok %s %.3f\n", path.c_str(), secondsSince(start));
+}
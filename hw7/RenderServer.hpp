@@ -0,0 +1,48 @@
+#ifndef RAYTRACING_RENDERSERVER_H
+#define RAYTRACING_RENDERSERVER_H
+
+#include <cstdio>
+#include <istream>
+#include <string>
+
+#include "SceneLoader.hpp"
+
+// Daemon mode: keeps a loaded scene and its BVHs resident and renders one job per request, so
+// the OBJ parsing and BVH builds are paid once instead of per image. Requests are read one per
+// line; every request gets exactly one reply line.
+//
+//   render [output=a.ppm] [spp=4] [width=400] [height=300] [denoise=0|1]
+//          [eye=x,y,z] [target=x,y,z] [up=x,y,z] [fov=deg] [aperture=a] [focus=d]
+//       -> ok <output> <seconds>
+//   load <scene.xml>    replaces the resident scene                  -> ok <scene.xml> <seconds>
+//   quit                                                              -> ok
+//
+// Failures answer "error <message>" and leave the server running. Settings left out of a render
+// request take the scene file's value, not the previous request's.
+class RenderServer
+{
+public:
+    explicit RenderServer(SceneDescription description);
+
+    // serves until quit or end of input
+    void Run(std::istream& in, FILE* out);
+
+private:
+    struct Defaults
+    {
+        int width, height, spp;
+        bool denoise;
+        std::string output;
+    };
+
+    // returns false on quit
+    bool Handle(const std::string& line, FILE* out);
+    void Render(std::istream& arguments, FILE* out);
+    void Load(const std::string& path, FILE* out);
+    void Resident(SceneDescription description);
+
+    SceneDescription resident;
+    Defaults defaults;
+};
+
+#endif //RAYTRACING_RENDERSERVER_H
@@ -2,100 +2,158 @@
 // Created by goksu on 2/25/20.
 //
 
+#include <atomic>
 #include <fstream>
+#include <stdexcept>
 #include <thread>
 #include <mutex>
 #include "Scene.hpp"
 #include "Renderer.hpp"
 
 
-inline float deg2rad(const float& deg) { return deg * M_PI / 180.0; }
-
 const float EPSILON = 0.00001;
 
+// both savers throw std::runtime_error when the file cannot be written
+static void savePPM(const char* path, const std::vector<Vector3f>& buffer, int width, int height, float gamma)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+        throw std::runtime_error(std::string("cannot write ") + path);
+    (void)fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    for (auto i = 0; i < height * width; ++i) {
+        static unsigned char color[3];
+        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, buffer[i].x), gamma));
+        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, buffer[i].y), gamma));
+        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, buffer[i].z), gamma));
+        fwrite(color, 1, 3, fp);
+    }
+    bool failed = ferror(fp);
+    if (fclose(fp) != 0 || failed)
+        throw std::runtime_error(std::string("cannot write ") + path);
+}
+
+// single-channel little-endian PFM, rows stored bottom to top
+static void savePFM(const char* path, const std::vector<float>& buffer, int width, int height)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+        throw std::runtime_error(std::string("cannot write ") + path);
+    (void)fprintf(fp, "Pf\n%d %d\n-1.0\n", width, height);
+    for (int j = height - 1; j >= 0; --j)
+        fwrite(&buffer[j * width], sizeof(float), width, fp);
+    bool failed = ferror(fp);
+    if (fclose(fp) != 0 || failed)
+        throw std::runtime_error(std::string("cannot write ") + path);
+}
+
 // The main render function. This where we iterate over all pixels in the image,
 // generate primary rays and cast these rays into the scene. The content of the
 // framebuffer is saved to a file.
-void Renderer::Render(const Scene& scene)
+//
+// With scene.guiding the samples are taken in passes of 1, 2, 4, ... per pixel, the last one
+// taking what is left of scene.spp, and a PathGuide learned by each pass guides the next. Every
+// pass is unbiased, so all of them are averaged into the image.
+void Renderer::Render(const Scene& scene, const Camera& camera)
 {
     std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    AOVBuffers aov(scene.width, scene.height);
 
-    float scale = tan(deg2rad(scene.fov * 0.5));
-    float imageAspectRatio = scene.width / (float)scene.height;
-    Vector3f eye_pos(278, 273, -800);
     int process = 0;
     std::mutex process_mutex;
 
-    // change the spp value to change sample ammount
-    int spp = 16;
+    int spp = scene.spp;
     std::cout << "SPP: " << spp << "\n";
-    int temp_process;
 
-    auto render_block = [&](int sx, int sy, int ex, int ey) {
-        for (uint32_t j = sy; j < ey; ++j) {
+    std::unique_ptr<PathGuide> guide;
+    if (scene.guiding)
+        guide = std::make_unique<PathGuide>(scene.bvh->WorldBound());
+
+    // samples [firstSample, endSample) of every pixel in the block
+    auto render_block = [&](int sx, int sy, int ex, int ey, int firstSample, int endSample) {
+        std::unique_ptr<Sampler> sampler = makeSampler(scene.samplerType, spp);
+        std::vector<Ray> rays;
+        rays.reserve(ex - sx);
+        for (int j = sy; j < ey; ++j) {
             int m = j * scene.width + sx;
-            for (uint32_t i = sx; i < ex; ++i) {
-                float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-                          imageAspectRatio * scale;
-                float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-
-                Vector3f dir = normalize(Vector3f(-x, y, 1));
-                for (int k = 0; k < spp; k++){
-                    framebuffer[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp;  
+            for (int k = firstSample; k < endSample; k++) {
+                rays.clear();
+                camera.generateRays(j, sx, ex, k, *sampler, rays);
+                for (size_t i = 0; i < rays.size(); ++i) {
+                    sampler->startPixel(sx + i, j);
+                    sampler->startSample(k, Camera::SampleDimensions);
+                    AOVSample features;
+                    Vector3f radiance = scene.castRay(rays[i], *sampler, &features, guide.get());
+                    framebuffer[m + i] += radiance / spp;
+                    float l = 0.2126f * radiance.x + 0.7152f * radiance.y + 0.0722f * radiance.z;
+                    aov.variance[m + i] += l * l / spp;
+                    aov.albedo[m + i] += features.albedo / spp;
+                    aov.normal[m + i] += features.normal / spp;
+                    aov.depth[m + i] += features.depth / spp;
                 }
-                m++;
-                process_mutex.lock();
-                process++;
-                UpdateProgress(1.0 * process / scene.width / scene.height);
-                process_mutex.unlock();
             }
+            process_mutex.lock();
+            process += (ex - sx) * (endSample - firstSample);
+            UpdateProgress(1.0 * process / scene.width / scene.height / spp);
+            process_mutex.unlock();
         }
     };
 
-    const int X_BLOCK = 5, Y_BLOCK = 5;
-
-    std::thread render_threads[X_BLOCK * Y_BLOCK];
+    // workers take 32x32 tiles from a shared counter, so the cost of bright or complex regions
+    // spreads over all threads
+    const int TILE = 32;
+    int tilesX = (scene.width + TILE - 1) / TILE, tilesY = (scene.height + TILE - 1) / TILE;
+    int thread_count = scene.threads > 0 ? scene.threads : std::max(1u, std::thread::hardware_concurrency());
+    for (int first = 0, pass = 1; first < spp; first += pass, pass *= 2) {
+        // without guiding everything is one pass; with it, a pass too short to leave as many
+        // samples after it is merged into the last one
+        int end = !guide || spp - first - pass < 2 * pass ? spp : first + pass;
+        if (guide)
+            guide->training = end < spp;
+
+        std::atomic<int> next_tile{0};
+        auto work = [&]() {
+            for (int t = next_tile++; t < tilesX * tilesY; t = next_tile++) {
+                int sx = (t % tilesX) * TILE, sy = (t / tilesX) * TILE;
+                render_block(sx, sy, std::min(sx + TILE, scene.width), std::min(sy + TILE, scene.height), first, end);
+            }
+        };
+        std::vector<std::thread> render_threads;
+        for (int i = 0; i < thread_count; i++)
+            render_threads.emplace_back(work);
+        for (auto& thread : render_threads)
+            thread.join();
+
+        if (end == spp)
+            break;
+        guide->refine(end - first);
+    }
 
-    int x_step = scene.width / X_BLOCK + 1, y_step = scene.height / Y_BLOCK + 1;
+    UpdateProgress(1.f);
 
-    for (int i = 0; i < X_BLOCK; i++) {
-        int sx = i * x_step, ex = std::min(sx + x_step, scene.width);
-        for (int j = 0; j < Y_BLOCK; j++) {
-            int sy = j * y_step, ey = std::min(sy + y_step, scene.height);
-            render_threads[i * X_BLOCK + j] = std::thread(render_block, sx, sy, ex, ey);
-        }
+    // save the AOVs, normals mapped from [-1,1] to [0,1]
+    std::vector<Vector3f> normal_image(aov.normal.size());
+    for (size_t i = 0; i < aov.normal.size(); ++i) {
+        // variance held E[l^2] so far; turn it into the variance of the mean
+        const Vector3f& c = framebuffer[i];
+        float l = 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+        aov.variance[i] = std::max(0.0f, aov.variance[i] - l * l) / std::max(1, spp - 1);
+        aov.normal[i] = normalize(aov.normal[i]);
+        normal_image[i] = (aov.normal[i] + Vector3f(1.0f)) * 0.5f;
     }
-
-    for (int i = 0; i < X_BLOCK * Y_BLOCK; i++) {
-        render_threads[i].join();
+    // named after the output, so renders to different outputs don't overwrite each other's
+    size_t dot = scene.output.rfind('.'), slash = scene.output.rfind('/');
+    bool extension = dot != std::string::npos && (slash == std::string::npos || dot > slash);
+    std::string stem = scene.output.substr(0, extension ? dot : std::string::npos);
+    savePPM((stem + "_albedo.ppm").c_str(), aov.albedo, scene.width, scene.height, 1.0f);
+    savePPM((stem + "_normal.ppm").c_str(), normal_image, scene.width, scene.height, 1.0f);
+    savePFM((stem + "_depth.pfm").c_str(), aov.depth, scene.width, scene.height);
+
+    if (scene.denoise) {
+        savePPM((stem + "_noisy.ppm").c_str(), framebuffer, scene.width, scene.height, 0.6f);
+        Denoiser denoiser;
+        framebuffer = denoiser.Denoise(framebuffer, aov, scene.width, scene.height);
     }
 
-    // for (uint32_t j = 0; j < scene.height; ++j) {
-    //     for (uint32_t i = 0; i < scene.width; ++i) {
-    //         // generate primary ray direction
-    //         float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-    //                   imageAspectRatio * scale;
-    //         float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-
-    //         Vector3f dir = normalize(Vector3f(-x, y, 1));
-    //         for (int k = 0; k < spp; k++){
-    //             framebuffer[m] += scene.castRay(Ray(eye_pos, dir), 0) / spp;  
-    //         }
-    //         m++;
-    //     }
-    //     UpdateProgress(j / (float)scene.height);
-    // }
-    UpdateProgress(1.f);
-
     // save framebuffer to file
-    FILE* fp = fopen("binary.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i) {
-        static unsigned char color[3];
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);    
+    savePPM(scene.output.c_str(), framebuffer, scene.width, scene.height, 0.6f);
 }
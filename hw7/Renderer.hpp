@@ -2,6 +2,7 @@
 // Created by goksu on 2/25/20.
 //
 #include "Scene.hpp"
+#include "Camera.hpp"
 
 #pragma once
 struct hit_payload
@@ -15,7 +16,7 @@ struct hit_payload
 class Renderer
 {
 public:
-    void Render(const Scene& scene);
+    void Render(const Scene& scene, const Camera& camera);
 
 private:
 };
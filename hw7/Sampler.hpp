@@ -0,0 +1,195 @@
+#ifndef RAYTRACING_SAMPLER_H
+#define RAYTRACING_SAMPLER_H
+
+#include "Vector.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+// Source of the random numbers of one path. Every sample value is a pure function of
+// (pixel, sample index, dimension, seed), so a sampler carries no sequence state beyond those
+// counters: startPixel/startSample reset them and each get1D/get2D call consumes one dimension.
+// The camera uses the first dimensions, the integrator continues from there.
+class Sampler
+{
+public:
+    explicit Sampler(int _spp, uint32_t _seed = 0) : spp(_spp), seed(_seed) {}
+    virtual ~Sampler() = default;
+
+    void startPixel(int x, int y) { pixelSeed = mix(seed ^ mix(x * 0x9e3779b9u ^ mix(y))); }
+    void startSample(uint32_t index, uint32_t dim = 0)
+    {
+        sampleIndex = index;
+        dimension = dim;
+    }
+
+    virtual float get1D() = 0;
+    virtual Vector2f get2D() = 0;
+    virtual std::unique_ptr<Sampler> clone() const = 0;
+
+    int samplesPerPixel() const { return spp; }
+
+protected:
+    // per-dimension seed; consecutive dimensions get decorrelated scrambles / permutations
+    uint32_t dimensionSeed() { return mix(pixelSeed ^ mix(dimension++ + 0x632be5abu)); }
+
+    static float toFloat(uint32_t v) { return std::min(v * 0x1p-32f, 0x1.fffffep-1f); }
+
+    static uint32_t mix(uint32_t x)
+    {
+        // lowbias32 finalizer (Chris Wellons)
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    int spp;
+    uint32_t seed, pixelSeed = 0, sampleIndex = 0, dimension = 0;
+};
+
+// Jittered strata with an independent random permutation of the strata for every dimension.
+// 2D draws use a jittered sqrt(spp) x sqrt(spp) grid when spp is a square and a Latin hypercube
+// otherwise, so every spp stays unbiased.
+class StratifiedSampler : public Sampler
+{
+public:
+    using Sampler::Sampler;
+
+    float get1D() override
+    {
+        uint32_t s = dimensionSeed();
+        uint32_t stratum = permute(sampleIndex, spp, s);
+        return std::min((stratum + toFloat(mix(s ^ sampleIndex))) / spp, 0x1.fffffep-1f);
+    }
+
+    Vector2f get2D() override
+    {
+        uint32_t s = dimensionSeed();
+        float jx = toFloat(mix(s ^ (2 * sampleIndex))), jy = toFloat(mix(s ^ (2 * sampleIndex + 1)));
+        int n = (int)std::sqrt((float)spp);
+        if (n * n == spp) {
+            uint32_t stratum = permute(sampleIndex, spp, s);
+            return Vector2f((stratum % n + jx) / n, (stratum / n + jy) / n);
+        }
+        uint32_t sx = permute(sampleIndex, spp, s), sy = permute(sampleIndex, spp, mix(s));
+        return Vector2f(std::min((sx + jx) / spp, 0x1.fffffep-1f), std::min((sy + jy) / spp, 0x1.fffffep-1f));
+    }
+
+    std::unique_ptr<Sampler> clone() const override { return std::make_unique<StratifiedSampler>(*this); }
+
+private:
+    // Kensler, "Correlated Multi-Jittered Sampling": the i-th element of a random permutation of
+    // [0, l) selected by p, without storing the permutation.
+    static uint32_t permute(uint32_t i, uint32_t l, uint32_t p)
+    {
+        if (l <= 1)
+            return 0;
+        uint32_t w = l - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        i %= l;
+        do {
+            i ^= p;
+            i *= 0xe170893d;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3f;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;
+            i *= 0x6935fa69;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3df;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= l);
+        return (i + p) % l;
+    }
+};
+
+// Owen-scrambled Sobol points padded across dimensions (Burley, "Practical Hash-based Owen
+// Scrambling", 2020): every draw takes the first one or two Sobol dimensions at a sample index
+// that is shuffled per dimension, then applies a hash-based nested uniform scramble. Prefixes of
+// any power-of-two length stay well stratified in every 1D and 2D projection.
+class SobolSampler : public Sampler
+{
+public:
+    using Sampler::Sampler;
+
+    float get1D() override
+    {
+        uint32_t s = dimensionSeed();
+        uint32_t index = nestedUniformScramble(sampleIndex, s);
+        return toFloat(nestedUniformScramble(reverseBits(index), mix(s + 1)));
+    }
+
+    Vector2f get2D() override
+    {
+        uint32_t s = dimensionSeed();
+        uint32_t index = nestedUniformScramble(sampleIndex, s);
+        uint32_t x = reverseBits(index), y = sobolDimension1(index);
+        return Vector2f(toFloat(nestedUniformScramble(x, mix(s + 1))), toFloat(nestedUniformScramble(y, mix(s + 2))));
+    }
+
+    std::unique_ptr<Sampler> clone() const override { return std::make_unique<SobolSampler>(*this); }
+
+private:
+    static uint32_t reverseBits(uint32_t x)
+    {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    // second Sobol dimension (primitive polynomial x + 1)
+    static uint32_t sobolDimension1(uint32_t index)
+    {
+        uint32_t x = 0;
+        for (uint32_t v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+            if (index & 1)
+                x ^= v;
+        return x;
+    }
+
+    static uint32_t laineKarrasPermutation(uint32_t x, uint32_t seed)
+    {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    static uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+    {
+        return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+    }
+};
+
+enum class SamplerType { Stratified, Sobol };
+
+inline std::unique_ptr<Sampler> makeSampler(SamplerType type, int spp, uint32_t seed = 0)
+{
+    if (type == SamplerType::Stratified)
+        return std::make_unique<StratifiedSampler>(spp, seed);
+    return std::make_unique<SobolSampler>(spp, seed);
+}
+
+#endif //RAYTRACING_SAMPLER_H
@@ -8,7 +8,11 @@
 
 void Scene::buildBVH() {
     printf(" - Generating BVH...\n\n");
-    this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    this->bvh = std::make_unique<BVHAccel>(objects, 1, BVHAccel::SplitMethod::NAIVE);
+    emit_area_sum = 0;
+    for (auto object : objects)
+        if (object->hasEmit())
+            emit_area_sum += object->getArea();
 }
 
 Intersection Scene::intersect(const Ray &ray) const
@@ -16,22 +20,22 @@ Intersection Scene::intersect(const Ray &ray) const
     return this->bvh->Intersect(ray);
 }
 
-void Scene::sampleLight(Intersection &pos, float &pdf) const
+// Picks an emitter proportionally to its area with u.x, then reuses the remainder of u.x
+// (rescaled to [0,1)) and u.y for the point on that emitter.
+void Scene::sampleLight(Intersection &pos, float &pdf, const Vector2f &u) const
 {
-    float emit_area_sum = 0;
+    float p = u.x * emit_area_sum;
+    float area_sum = 0;
     for (uint32_t k = 0; k < objects.size(); ++k) {
         if (objects[k]->hasEmit()){
-            emit_area_sum += objects[k]->getArea();
-        }
-    }
-    float p = get_random_float() * emit_area_sum;
-    emit_area_sum = 0;
-    for (uint32_t k = 0; k < objects.size(); ++k) {
-        if (objects[k]->hasEmit()){
-            emit_area_sum += objects[k]->getArea();
-            if (p <= emit_area_sum){
-                objects[k]->Sample(pos, pdf);
+            float area = objects[k]->getArea();
+            area_sum += area;
+            if (p <= area_sum){
+                float ux = std::min(std::max((p - (area_sum - area)) / area, 0.0f), 0x1.fffffep-1f);
+                objects[k]->Sample(pos, pdf, Vector2f(ux, u.y));
                 pos.obj = objects[k];
+                // the object's pdf is per its own area; account for choosing it
+                pdf *= area / emit_area_sum;
                 break;
             }
         }
@@ -59,62 +63,181 @@ bool Scene::trace(
     return (*hitObject != nullptr);
 }
 
-// Implementation of Path Tracing
-Vector3f Scene::castRay(const Ray &ray, int depth) const
+// Moves a ray origin off the surface at p, to the side of n that w leaves into, so the new
+// ray can't hit the surface it starts on. The offset scales with the magnitude of p.
+static Vector3f offsetRayOrigin(const Vector3f &p, const Vector3f &n, const Vector3f &w)
 {
-    // TO DO Implement Path Tracing Algorithm here
+    float eps = 1e-4f * std::max(1.0f, std::max(std::fabs(p.x), std::max(std::fabs(p.y), std::fabs(p.z))));
+    return dotProduct(w, n) > 0 ? p + n * eps : p - n * eps;
+}
 
-    Vector3f dir_light = Vector3f(0, 0, 0), indir_light = Vector3f(0, 0, 0);
-    Vector3f wo = (-ray.direction).normalized();
+static float powerHeuristic(float fPdf, float gPdf)
+{
+    float f = fPdf * fPdf, g = gPdf * gPdf;
+    return f + g > 0 ? f / (f + g) : 0;
+}
 
-    auto format = [](Vector3f &a) {
-        if(a.x < 0) a.x = 0;
-        if(a.y < 0) a.y = 0;
-        if(a.z < 0) a.z = 0;
+// Implementation of Path Tracing
+//
+// Iterative form: the path is extended one vertex at a time while beta carries the product of
+// BSDF * cos / pdf (and Russian roulette weights) along it, so no stack is kept per bounce.
+// At every vertex with a non-delta BSDF one light sample is taken, from the environment or
+// the area emitters with equal probability when both exist. Light found by the BSDF sampled
+// ray is combined with it by multiple importance sampling (power heuristic); after delta
+// bounces and for the camera ray it counts fully, as light sampling can't reach it.
+//
+// With a guide, bounces off non-delta surfaces pick the guide's learned distribution instead of
+// the BSDF with probability 1 - guide->bsdfFraction, and every pdf used for MIS is that of the
+// mixture. The path's vertices are kept, and once it ends each guided vertex records the radiance
+// that arrived along its bounce: what L gained after the bounce, divided by beta at that point.
+Vector3f Scene::castRay(const Ray &ray, Sampler &sampler, AOVSample *aov, PathGuide *guide) const
+{
+    struct GuideVertex
+    {
+        Vector3f p, wi, L, beta;  // L and beta right after the bounce
+        float pdf;
     };
+    const size_t MaxGuideVertices = 32;
+    // reused by the calls on the same thread and only touched while training, so unguided
+    // paths construct nothing
+    thread_local std::vector<GuideVertex> vertices;
+    bool recording = guide && guide->training;
+    if (recording)
+        vertices.clear();
+
+    Vector3f L(0.0f), beta(1.0f);
+    Ray r = ray;
+    bool specularBounce = false;
+    float bsdf_pdf_prev = 0;  // solid angle pdf of the BSDF sample that produced r
+    // probability of sampling the environment rather than the area emitters
+    float p_env = environment ? (emit_area_sum > 0 ? 0.5f : 1.0f) : 0.0f;
+
+    for (int depth = 0; ; ++depth) {
+        Intersection intersection = Scene::intersect(r);
+        if (!intersection.happened) {
+            if (environment) {
+                Vector3f Le = environment->Le(r.direction);
+                if (depth == 0 || specularBounce)
+                    L += beta * Le;
+                else
+                    L += beta * Le * powerHeuristic(bsdf_pdf_prev, p_env * environment->Pdf(r.direction));
+            }
+            break;
+        }
+
+        const Vector3f &N = intersection.normal;
+        Material *m = intersection.m;
+        if (depth == 0 && aov) {
+            aov->albedo = m->m_type == DIFFUSE ? m->Kd : m->Ks;
+            aov->normal = N;
+            aov->depth = intersection.distance;
+        }
 
-    Intersection intersection = Scene::intersect(ray);
-    if (intersection.happened) {
-        if (!(intersection.emit.norm() > 1e-2)) {
-
-            Intersection light_pos;
-            float light_pdf;
-            sampleLight(light_pos, light_pdf);
-            
-            Intersection test_intersection;
-            Ray test_ray = Ray(intersection.coords, (light_pos.coords-intersection.coords).normalized());
-            test_intersection = Scene::intersect(test_ray);
-
-            // printf("%f\n", (test_intersection.coords-light_pos.coords).norm());
-            if (test_intersection.happened && (test_intersection.coords-light_pos.coords).norm() < 1e-2) {
-                // printf("light!\n");
-                dir_light = light_pos.emit 
-                                * intersection.m->eval(test_ray.direction, wo, intersection.normal)
-                                * dotProduct(intersection.normal, test_ray.direction)
-                                * dotProduct(-test_ray.direction, light_pos.normal)
-                                / dotProduct(intersection.coords-light_pos.coords, intersection.coords-light_pos.coords)
-                                / light_pdf;
-
-                // std::cout << intersection.m->eval(test_ray.direction, ray.direction, intersection.normal) << std::endl;
-
-                // if (dir_light.norm() < 1e-2) {
-                //     std::cout << light_pos.emit << "\n* " << intersection.m->eval(test_ray.direction, ray.direction, intersection.normal) << "\n* " << dotProduct(test_ray.direction, light_pos.normal) << "\n* ";
-                // }
+        Vector3f wo = -r.direction;
+        // draw every dimension of this bounce up front so paths stay aligned in the sampler
+        Vector2f u_light = sampler.get2D(), u_bsdf = sampler.get2D();
+        float u_lobe = sampler.get1D(), u_rr = sampler.get1D(), u_select = sampler.get1D();
+        float u_guide = guide ? sampler.get1D() : 0;
+        const DirectionalTree *tree = guide && !m->isDelta() ? guide->lookup(intersection.coords) : nullptr;
+        // pdf of the strategy that samples the bounce, BSDF alone or mixed with the guide
+        auto mixturePdf = [&](float bsdf_pdf, const Vector3f &wi) {
+            if (!tree)
+                return bsdf_pdf;
+            return guide->bsdfFraction * bsdf_pdf + (1 - guide->bsdfFraction) * PathGuide::pdf(*tree, wi);
+        };
+
+        if (intersection.emit.norm() > 1e-2) {
+            // emitters that light sampling can't pick (moving instances) count fully as well
+            if (depth == 0 || specularBounce || !intersection.obj->hasEmit()) {
+                L += beta * intersection.emit;
+            } else {
+                float cos_light = dotProduct(wo, N);
+                if (cos_light > 0) {
+                    float dist = intersection.distance;
+                    float light_pdf = (1 - p_env) / emit_area_sum * dist * dist / cos_light;
+                    L += beta * intersection.emit * powerHeuristic(bsdf_pdf_prev, light_pdf);
+                }
+            }
+        } else if (!m->isDelta() && (p_env > 0 || emit_area_sum > 0)) {
+            if (u_select < p_env) {
+                Vector3f wi;
+                float light_pdf, bsdf_pdf;
+                Vector3f Le = environment->Sample(u_light, wi, light_pdf);
+                light_pdf *= p_env;
+                Vector3f f = m->evalBSDF(wi, wo, N, bsdf_pdf);
+                bsdf_pdf = mixturePdf(bsdf_pdf, wi);
+                if (light_pdf > 0 && bsdf_pdf > 0) {
+                    Ray test_ray(offsetRayOrigin(intersection.coords, N, wi), wi, r.t);
+                    if (!Scene::intersect(test_ray).happened)
+                        L += beta * Le * f * std::fabs(dotProduct(N, wi)) * powerHeuristic(light_pdf, bsdf_pdf) / light_pdf;
+                }
+            } else {
+                Intersection light_pos;
+                float light_pdf;
+                sampleLight(light_pos, light_pdf, u_light);
+
+                Vector3f origin = offsetRayOrigin(intersection.coords, N, light_pos.coords - intersection.coords);
+                Vector3f to_light = light_pos.coords - origin;
+                float dist2 = dotProduct(to_light, to_light), dist = std::sqrt(dist2);
+                Vector3f wi = to_light / dist;
+                float cos_light = dotProduct(-wi, light_pos.normal);
+                float bsdf_pdf;
+                Vector3f f = m->evalBSDF(wi, wo, N, bsdf_pdf);
+                bsdf_pdf = mixturePdf(bsdf_pdf, wi);
+                if (cos_light > 0 && bsdf_pdf > 0) {
+                    // area pdf to solid angle
+                    light_pdf *= (1 - p_env) * dist2 / cos_light;
+                    // the light is visible if nothing is hit noticeably before it
+                    Intersection test_intersection = Scene::intersect(Ray(origin, wi, r.t));
+                    if (!test_intersection.happened || test_intersection.distance > dist * (1 - 1e-4f)) {
+                        L += beta * light_pos.emit * f * std::fabs(dotProduct(N, wi))
+                             * powerHeuristic(light_pdf, bsdf_pdf) / light_pdf;
+                    }
+                }
             }
-        } else if (depth == 0) {
-            dir_light = intersection.emit;
         }
-        if (get_random_float() < RussianRoulette) {
-            Vector3f wi = intersection.m->sample(wo, intersection.normal);
-            indir_light = castRay(Ray(intersection.coords, wi), depth+1)
-                            * intersection.m->eval(wi, wo, intersection.normal)
-                            * dotProduct(intersection.normal, wi)
-                            / intersection.m->pdf(wi, wo, intersection.normal)
-                            / RussianRoulette;
 
+        if (depth == maxDepth)
+            break;
+
+        // past rrMinDepth, continue with a probability that follows the path throughput so dim
+        // paths are cut early and bright ones are rarely killed
+        if (depth >= rrMinDepth) {
+            float p = std::min(RussianRoulette, std::max(beta.x, std::max(beta.y, beta.z)));
+            if (u_rr >= p)
+                break;
+            beta = beta / p;
         }
 
+        BSDFSample bs;
+        if (tree && u_guide >= guide->bsdfFraction) {
+            bs.wi = PathGuide::sample(*tree, u_bsdf);
+            bs.f = m->evalBSDF(bs.wi, wo, N, bs.pdf);
+            bs.pdf = mixturePdf(bs.pdf, bs.wi);
+            // the guide may pick directions the BSDF doesn't scatter into
+            if (bs.pdf <= 0 || (bs.f.x == 0 && bs.f.y == 0 && bs.f.z == 0))
+                break;
+        } else {
+            if (!m->sampleBSDF(wo, N, u_bsdf, u_lobe, bs))
+                break;
+            if (!bs.delta)
+                bs.pdf = mixturePdf(bs.pdf, bs.wi);
+        }
+        beta = beta * bs.f * std::fabs(dotProduct(N, bs.wi)) / bs.pdf;
+        specularBounce = bs.delta;
+        bsdf_pdf_prev = bs.pdf;
+        if (recording && !bs.delta && vertices.size() < MaxGuideVertices)
+            vertices.push_back({intersection.coords, bs.wi, L, beta, bs.pdf});
+        r = Ray(offsetRayOrigin(intersection.coords, N, bs.wi), bs.wi, r.t);
     }
-    
-    return dir_light + indir_light;
-}
\ No newline at end of file
+
+    for (size_t i = 0; recording && i < vertices.size(); ++i) {
+        const GuideVertex &v = vertices[i];
+        Vector3f gained = L - v.L;
+        // per channel, skipping channels the path no longer carries
+        Vector3f Li(v.beta.x > 0 ? gained.x / v.beta.x : 0, v.beta.y > 0 ? gained.y / v.beta.y : 0,
+                    v.beta.z > 0 ? gained.z / v.beta.z : 0);
+        guide->record(v.p, v.wi, (0.2126f * Li.x + 0.7152f * Li.y + 0.0722f * Li.z) / v.pdf);
+    }
+    return L;
+}
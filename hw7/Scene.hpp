@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
 #include <vector>
 #include "Vector.hpp"
 #include "Object.hpp"
@@ -11,6 +13,10 @@
 #include "AreaLight.hpp"
 #include "BVH.hpp"
 #include "Ray.hpp"
+#include "Sampler.hpp"
+#include "Denoiser.hpp"
+#include "EnvironmentLight.hpp"
+#include "PathGuide.hpp"
 
 
 class Scene
@@ -21,22 +27,46 @@ public:
     int height = 960;
     double fov = 40;
     Vector3f backgroundColor = Vector3f(0.235294, 0.67451, 0.843137);
-    int maxDepth = 1;
+    // bounces after the camera ray; direct light is still gathered at the last vertex
+    int maxDepth = 16;
+    // Russian roulette starts after rrMinDepth bounces and continues with a probability of at most RussianRoulette
+    int rrMinDepth = 3;
     float RussianRoulette = 0.8;
+    SamplerType samplerType = SamplerType::Sobol;
+    // run the AOV-guided denoiser on the framebuffer before it is written
+    bool denoise = true;
+    int spp = 16;
+    // learn and sample an SD-tree path guide over passes of doubling spp; see PathGuide.hpp
+    bool guiding = false;
+    // render worker threads; 0 uses one per hardware thread
+    int threads = 0;
+    // the image is written here; the pre-denoise image and the AOVs are written next to it with
+    // _noisy, _albedo, _normal and _depth suffixes
+    std::string output = "binary.ppm";
 
     Scene(int w, int h) : width(w), height(h)
     {}
 
     void Add(Object *object) { objects.push_back(object); }
+    // the scene keeps the object alive
+    void Add(std::unique_ptr<Object> object)
+    {
+        objects.push_back(object.get());
+        ownedObjects.push_back(std::move(object));
+    }
     void Add(std::unique_ptr<Light> light) { lights.push_back(std::move(light)); }
 
     const std::vector<Object*>& get_objects() const { return objects; }
     const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     Intersection intersect(const Ray& ray) const;
-    BVHAccel *bvh;
+    std::unique_ptr<BVHAccel> bvh;
+    // total area of the emitting objects, set by buildBVH
+    float emit_area_sum = 0;
     void buildBVH();
-    Vector3f castRay(const Ray &ray, int depth) const;
-    void sampleLight(Intersection &pos, float &pdf) const;
+    // aov, when given, receives the features of the first hit; guide, when given, guides the
+    // bounces and is trained with the path unless its training flag is off
+    Vector3f castRay(const Ray &ray, Sampler &sampler, AOVSample *aov = nullptr, PathGuide *guide = nullptr) const;
+    void sampleLight(Intersection &pos, float &pdf, const Vector2f &u) const;
     bool trace(const Ray &ray, const std::vector<Object*> &objects, float &tNear, uint32_t &index, Object **hitObject);
     std::tuple<Vector3f, Vector3f> HandleAreaLight(const AreaLight &light, const Vector3f &hitPoint, const Vector3f &N,
                                                    const Vector3f &shadowPointOrig,
@@ -45,7 +75,13 @@ public:
 
     // creating the scene (adding objects and lights)
     std::vector<Object* > objects;
+    // lights rays that leave the scene; nullptr means they contribute nothing
+    std::unique_ptr<EnvironmentLight> environment;
     std::vector<std::unique_ptr<Light> > lights;
+    // objects created for the scene, e.g. by the scene loader
+    std::vector<std::unique_ptr<Object> > ownedObjects;
+    // scene-lifetime storage for materials and other trivially destructible data
+    MemoryArena arena;
 
     // Compute reflection direction
     Vector3f reflect(const Vector3f &I, const Vector3f &N) const
@@ -0,0 +1,290 @@
+#include "SceneLoader.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "MovingInstance.hpp"
+#include "Sphere.hpp"
+#include "SphereSet.hpp"
+#include "Triangle.hpp"
+#include "tinyxml2.h"
+
+using namespace tinyxml2;
+
+namespace {
+
+std::string elementName(const XMLElement* e)
+{
+    const char* name = e->Attribute("name");
+    return std::string("<") + e->Name() + (name ? std::string(" name=\"") + name + "\"" : "") + ">";
+}
+
+// "x y z", or a single number for all three components
+Vector3f parseVector(const XMLElement* e, const char* attribute, const Vector3f& fallback)
+{
+    const char* text = e->Attribute(attribute);
+    if (!text)
+        return fallback;
+    std::istringstream in(text);
+    float x, y, z;
+    if (!(in >> x))
+        throw std::runtime_error("bad vector in " + elementName(e) + " attribute " + attribute);
+    if (!(in >> y))
+        return Vector3f(x);
+    if (!(in >> z))
+        throw std::runtime_error("bad vector in " + elementName(e) + " attribute " + attribute);
+    return Vector3f(x, y, z);
+}
+
+template <typename T>
+T parseNumber(const XMLElement* e, const char* attribute, T fallback)
+{
+    const char* text = e->Attribute(attribute);
+    if (!text)
+        return fallback;
+    std::istringstream in(text);
+    T value;
+    if (!(in >> value))
+        throw std::runtime_error("bad number in " + elementName(e) + " attribute " + attribute);
+    return value;
+}
+
+bool parseBool(const XMLElement* e, const char* attribute, bool fallback)
+{
+    const char* text = e->Attribute(attribute);
+    if (!text)
+        return fallback;
+    if (!std::strcmp(text, "true") || !std::strcmp(text, "1"))
+        return true;
+    if (!std::strcmp(text, "false") || !std::strcmp(text, "0"))
+        return false;
+    throw std::runtime_error("bad boolean in " + elementName(e) + " attribute " + attribute);
+}
+
+std::string requireAttribute(const XMLElement* e, const char* attribute)
+{
+    const char* text = e->Attribute(attribute);
+    if (!text)
+        throw std::runtime_error(elementName(e) + " needs a " + attribute + " attribute");
+    return text;
+}
+
+std::string resolvePath(const std::string& directory, const std::string& path)
+{
+    if (path.empty() || path[0] == '/' || directory.empty())
+        return path;
+    return directory + "/" + path;
+}
+
+Material* parseMaterial(const XMLElement* e, MemoryArena& arena)
+{
+    static_assert(std::is_trivially_destructible<Material>::value, "the arena never destroys materials");
+    static const std::map<std::string, MaterialType> types = {
+        {"diffuse", DIFFUSE}, {"mirror", MIRROR}, {"conductor", CONDUCTOR}, {"dielectric", DIELECTRIC}};
+    auto type = types.find(e->Attribute("type") ? e->Attribute("type") : "diffuse");
+    if (type == types.end())
+        throw std::runtime_error("unknown material type in " + elementName(e));
+
+    Material* material = arena.Create<Material>(type->second, parseVector(e, "emission", Vector3f(0.0f)));
+    material->Kd = parseVector(e, "kd", material->Kd);
+    material->Ks = parseVector(e, "ks", material->Ks);
+    material->ior = parseNumber(e, "ior", material->ior);
+    material->roughness = parseNumber(e, "roughness", material->roughness);
+    return material;
+}
+
+// The spheres of a <spheres> element: its <sphere> children, after the lines "x y z radius" of
+// its file if it has one. Blank lines and lines starting with # are skipped.
+void parseSpheres(const XMLElement* e, const std::string& directory, std::vector<Vector3f>& centers,
+                  std::vector<float>& radii)
+{
+    if (e->Attribute("file")) {
+        std::string path = resolvePath(directory, e->Attribute("file"));
+        std::ifstream file(path);
+        if (!file)
+            throw std::runtime_error("cannot open spheres " + path);
+        std::string line;
+        for (int number = 1; std::getline(file, line); ++number) {
+            std::istringstream in(line);
+            std::string first;
+            if (!(in >> first) || first[0] == '#')
+                continue;
+            in.str(line);
+            in.clear();
+            float x, y, z, r;
+            if (!(in >> x >> y >> z >> r) || (in >> first))
+                throw std::runtime_error("bad sphere on line " + std::to_string(number) + " of " + path);
+            centers.emplace_back(x, y, z);
+            radii.push_back(r);
+        }
+    }
+    for (auto s = e->FirstChildElement(); s; s = s->NextSiblingElement()) {
+        if (std::strcmp(s->Name(), "sphere"))
+            throw std::runtime_error("unknown element " + elementName(s) + " in " + elementName(e));
+        centers.push_back(parseVector(s, "center", Vector3f(0.0f)));
+        radii.push_back(parseNumber(s, "radius", 1.0f));
+    }
+    if (centers.empty())
+        throw std::runtime_error(elementName(e) + " has no spheres");
+}
+
+// the transform children of a mesh or sphere; end attributes make it move
+AnimatedTransform parseTransform(const XMLElement* object)
+{
+    AnimatedTransform toWorld;
+    for (auto e = object->FirstChildElement(); e; e = e->NextSiblingElement()) {
+        std::string name = e->Name();
+        if (name == "translate") {
+            Vector3f value = parseVector(e, "value", Vector3f(0.0f));
+            toWorld.translate(value, parseVector(e, "end", value));
+        } else if (name == "scale") {
+            Vector3f value = parseVector(e, "value", Vector3f(1.0f));
+            toWorld.scale(value, parseVector(e, "end", value));
+        } else if (name == "rotate") {
+            float angle = parseNumber(e, "angle", 0.0f);
+            toWorld.rotate(parseVector(e, "axis", Vector3f(0, 1, 0)), angle, parseNumber(e, "end", angle));
+        } else {
+            throw std::runtime_error("unknown transform " + elementName(e));
+        }
+    }
+    return toWorld;
+}
+
+}
+
+SceneDescription loadScene(const std::string& filename)
+{
+    XMLDocument document;
+    if (document.LoadFile(filename.c_str()) != XML_SUCCESS)
+        throw std::runtime_error("cannot parse scene " + filename + ": " + document.ErrorName());
+    const XMLElement* root = document.FirstChildElement("scene");
+    if (!root)
+        throw std::runtime_error(filename + " has no <scene> element");
+    size_t slash = filename.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "" : filename.substr(0, slash);
+
+    SceneDescription description;
+    const XMLElement* film = root->FirstChildElement("film");
+    int width = film ? parseNumber(film, "width", 784) : 784;
+    int height = film ? parseNumber(film, "height", 784) : 784;
+    if (width <= 0 || height <= 0)
+        throw std::runtime_error("bad film size in " + filename);
+    description.scene = std::make_unique<Scene>(width, height);
+    Scene& scene = *description.scene;
+    if (film && film->Attribute("output"))
+        scene.output = film->Attribute("output");
+
+    if (const XMLElement* e = root->FirstChildElement("integrator")) {
+        scene.spp = parseNumber(e, "spp", scene.spp);
+        scene.maxDepth = parseNumber(e, "maxdepth", scene.maxDepth);
+        scene.rrMinDepth = parseNumber(e, "rrdepth", scene.rrMinDepth);
+        scene.RussianRoulette = parseNumber(e, "rrprob", scene.RussianRoulette);
+        scene.denoise = parseBool(e, "denoise", scene.denoise);
+        scene.guiding = parseBool(e, "guiding", scene.guiding);
+        scene.threads = parseNumber(e, "threads", scene.threads);
+        if (const char* sampler = e->Attribute("sampler")) {
+            if (!std::strcmp(sampler, "sobol"))
+                scene.samplerType = SamplerType::Sobol;
+            else if (!std::strcmp(sampler, "stratified"))
+                scene.samplerType = SamplerType::Stratified;
+            else
+                throw std::runtime_error(std::string("unknown sampler ") + sampler);
+        }
+        if (scene.spp <= 0 || scene.maxDepth < 0 || scene.threads < 0)
+            throw std::runtime_error("bad integrator settings in " + filename);
+    }
+
+    std::map<std::string, Material*> materials;
+    for (auto e = root->FirstChildElement("material"); e; e = e->NextSiblingElement("material")) {
+        std::string name = requireAttribute(e, "name");
+        materials[name] = parseMaterial(e, scene.arena);
+    }
+    auto findMaterial = [&](const XMLElement* e) {
+        auto it = materials.find(requireAttribute(e, "material"));
+        if (it == materials.end())
+            throw std::runtime_error("undefined material in " + elementName(e));
+        return it->second;
+    };
+
+    // the OBJ parsing and per-mesh BVH builds dominate load time, so every mesh gets its own task;
+    // objects are added in file order once all of them are done
+    std::vector<std::future<std::unique_ptr<Object>>> objects;
+    for (auto e = root->FirstChildElement(); e; e = e->NextSiblingElement()) {
+        std::string name = e->Name();
+        if (name == "mesh") {
+            std::string path = resolvePath(directory, requireAttribute(e, "file"));
+            if (!std::ifstream(path))
+                throw std::runtime_error("cannot open mesh " + path);
+            Material* material = findMaterial(e);
+            AnimatedTransform toWorld = parseTransform(e);
+            objects.push_back(std::async(std::launch::async, [path, material, toWorld]() -> std::unique_ptr<Object> {
+                // static meshes are baked into world space, moving ones are instanced
+                if (!toWorld.isAnimated())
+                    return std::make_unique<MeshTriangle>(path, material, toWorld.at(0));
+                return std::make_unique<MovingInstance>(std::make_unique<MeshTriangle>(path, material), toWorld);
+            }));
+        } else if (name == "sphere") {
+            Vector3f center = parseVector(e, "center", Vector3f(0.0f));
+            float radius = parseNumber(e, "radius", 1.0f);
+            AnimatedTransform toWorld = parseTransform(e);
+            // like meshes, static spheres are baked into world space, so emissive ones stay lights;
+            // a sphere stays one only under a uniform scale
+            std::unique_ptr<Object> object;
+            if (!toWorld.isAnimated()) {
+                Transform t = toWorld.at(0);
+                Vector3f x = t.vector(Vector3f(1, 0, 0)), y = t.vector(Vector3f(0, 1, 0)), z = t.vector(Vector3f(0, 0, 1));
+                float scale = x.norm(), tolerance = 1e-4f * scale * scale;
+                if (std::fabs(dotProduct(y, y) - scale * scale) > tolerance ||
+                    std::fabs(dotProduct(z, z) - scale * scale) > tolerance ||
+                    std::fabs(dotProduct(x, y)) > tolerance || std::fabs(dotProduct(x, z)) > tolerance ||
+                    std::fabs(dotProduct(y, z)) > tolerance)
+                    throw std::runtime_error("non-uniform scale on " + elementName(e));
+                object = std::make_unique<Sphere>(t.point(center), radius * scale, findMaterial(e));
+            } else {
+                object = std::make_unique<MovingInstance>(std::make_unique<Sphere>(center, radius, findMaterial(e)),
+                                                          toWorld);
+            }
+            std::promise<std::unique_ptr<Object>> sphere;
+            sphere.set_value(std::move(object));
+            objects.push_back(sphere.get_future());
+        } else if (name == "spheres") {
+            std::vector<Vector3f> centers;
+            std::vector<float> radii;
+            parseSpheres(e, directory, centers, radii);
+            Material* material = findMaterial(e);
+            objects.push_back(std::async(std::launch::async, [centers, radii, material]() -> std::unique_ptr<Object> {
+                return std::make_unique<SphereSet>(centers, radii, material);
+            }));
+        } else if (name == "environment") {
+            scene.environment = std::make_unique<EnvironmentLight>(resolvePath(directory, requireAttribute(e, "file")),
+                                                                   parseNumber(e, "scale", 1.0f));
+        } else if (name != "film" && name != "integrator" && name != "camera" && name != "material") {
+            throw std::runtime_error("unknown element " + elementName(e) + " in " + filename);
+        }
+    }
+    for (auto& object : objects)
+        scene.Add(object.get());
+
+    CameraParameters& view = description.view;
+    view.fov = scene.fov;
+    if (const XMLElement* camera = root->FirstChildElement("camera")) {
+        view.eye = parseVector(camera, "eye", view.eye);
+        view.target = parseVector(camera, "target", view.target);
+        view.up = parseVector(camera, "up", view.up);
+        view.fov = parseNumber(camera, "fov", view.fov);
+        view.aperture = parseNumber(camera, "aperture", view.aperture);
+        view.focus = parseNumber(camera, "focus", view.focus);
+        view.shutterOpen = parseNumber(camera, "shutteropen", view.shutterOpen);
+        view.shutterClose = parseNumber(camera, "shutterclose", view.shutterClose);
+        if (view.shutterOpen < 0 || view.shutterClose > 1 || view.shutterOpen > view.shutterClose)
+            throw std::runtime_error("the shutter interval must lie in [0, 1]");
+    }
+    scene.fov = view.fov;
+    description.camera = view.build(scene.width, scene.height);
+    return description;
+}
@@ -0,0 +1,66 @@
+#ifndef RAYTRACING_SCENELOADER_H
+#define RAYTRACING_SCENELOADER_H
+
+#include <memory>
+#include <string>
+
+#include "Camera.hpp"
+#include "Scene.hpp"
+
+// the arguments the camera was built from, so it can be rebuilt with some of them changed
+struct CameraParameters
+{
+    Vector3f eye = Vector3f(278, 273, -800), target = Vector3f(278, 273, 0), up = Vector3f(0, 1, 0);
+    float fov = 40, aperture = 0, focus = 1;
+    float shutterOpen = 0, shutterClose = 0;
+
+    std::unique_ptr<Camera> build(int width, int height) const
+    {
+        auto camera = std::make_unique<Camera>(eye, target, up, fov, width, height, aperture, focus);
+        camera->shutterOpen = shutterOpen;
+        camera->shutterClose = shutterClose;
+        return camera;
+    }
+};
+
+struct SceneDescription
+{
+    std::unique_ptr<Scene> scene;
+    std::unique_ptr<Camera> camera;
+    CameraParameters view;
+};
+
+// Reads an XML scene file such as scenes/cornellbox.xml:
+//
+//   <scene>
+//     <film width="784" height="784" output="binary.ppm"/>
+//     <integrator spp="16" maxdepth="16" rrdepth="3" rrprob="0.8" sampler="sobol" denoise="true" threads="0"
+//                 guiding="false"/>
+//     <camera eye="278 273 -800" target="278 273 0" up="0 1 0" fov="40" aperture="0" focus="1"
+//             shutteropen="0" shutterclose="1"/>
+//     <material name="white" type="diffuse" kd="0.725 0.71 0.68" emission="0"/>
+//     <mesh file="../models/cornellbox/floor.obj" material="white">
+//       <scale value="2"/> <rotate axis="0 1 0" angle="30"/> <translate value="0 10 0"/>
+//     </mesh>
+//     <sphere center="0 0 0" radius="1" material="white">
+//       <translate value="0 0 0" end="0 20 0"/>
+//     </sphere>
+//     <spheres file="particles.txt" material="white">
+//       <sphere center="0 0 0" radius="1"/>
+//     </spheres>
+//     <environment file="sky.hdr" scale="1"/>
+//   </scene>
+//
+// Every element and attribute is optional except the file/material references; missing ones keep
+// the Scene and Camera defaults. Vectors are one or three numbers. Material types are diffuse,
+// mirror, conductor and dielectric, with kd, ks, ior and roughness. The transform children of a
+// mesh or sphere apply in document order; giving any of them an end value (the angle for rotate)
+// animates the object from value at frame time 0 to end at time 1, seen as motion blur by a
+// camera whose shutter interval is open; a static transform of a sphere must scale it uniformly.
+// Animated objects are not light sources. A spheres element is one SphereSet of many static
+// spheres with one material: its sphere children, after the "x y z radius" lines of its
+// optional file. Emissive materials make area lights. File paths are relative to the scene
+// file. Meshes and sphere sets are built in parallel. Errors throw std::runtime_error.
+SceneDescription loadScene(const std::string& filename);
+
+#endif //RAYTRACING_SCENELOADER_H
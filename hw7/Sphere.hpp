@@ -16,7 +16,7 @@ public:
     float radius, radius2;
     Material *m;
     float area;
-    Sphere(const Vector3f &c, const float &r, Material* mt = new Material()) : center(c), radius(r), radius2(r * r), m(mt), area(4 * M_PI *r *r) {}
+    Sphere(const Vector3f &c, const float &r, Material* mt) : center(c), radius(r), radius2(r * r), m(mt), area(4 * M_PI *r *r) {}
     bool intersect(const Ray& ray) {
         // analytic solution
         Vector3f L = ray.origin - center;
@@ -64,6 +64,7 @@ public:
         result.m = this->m;
         result.obj = this;
         result.distance = t0;
+        result.emit = m->getEmission();
         return result;
 
     }
@@ -77,9 +78,11 @@ public:
         return Bounds3(Vector3f(center.x-radius, center.y-radius, center.z-radius),
                        Vector3f(center.x+radius, center.y+radius, center.z+radius));
     }
-    void Sample(Intersection &pos, float &pdf){
-        float theta = 2.0 * M_PI * get_random_float(), phi = M_PI * get_random_float();
-        Vector3f dir(std::cos(phi), std::sin(phi)*std::cos(theta), std::sin(phi)*std::sin(theta));
+    void Sample(Intersection &pos, float &pdf, const Vector2f &u){
+        // uniform on the sphere, matching pdf = 1 / area
+        float z = 1.0f - 2.0f * u.x, phi = 2.0f * M_PI * u.y;
+        float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        Vector3f dir(r * std::cos(phi), r * std::sin(phi), z);
         pos.coords = center + radius * dir;
         pos.normal = dir;
         pos.emit = m->getEmission();
@@ -0,0 +1,210 @@
+#ifndef RAYTRACING_SPHERESET_H
+#define RAYTRACING_SPHERESET_H
+
+#include "BVH.hpp"
+#include "Bounds3.hpp"
+#include "Intersection.hpp"
+#include "Material.hpp"
+#include "Object.hpp"
+#include "../common/SpherePacket.hpp"
+#include "Vector.hpp"
+
+#include <vector>
+
+class SphereSet;
+
+// Eight spheres of a SphereSet tested together; this is the leaf object the set's BVH is
+// built over, the same way Triangle is the leaf of MeshTriangle.
+class SpherePacketObject : public Object
+{
+public:
+    SpherePacket packet;
+    const SphereSet* set;
+    uint32_t first, count; // spheres [first, first + count) of the set
+    Bounds3 bounds;
+    float area;
+
+    SpherePacketObject(const SphereSet* s, uint32_t f, uint32_t n);
+
+    bool intersect(const Ray& ray) override;
+    bool intersect(const Ray& ray, float& tnear, uint32_t& index) const override;
+    Intersection getIntersection(Ray ray) override;
+    void getSurfaceProperties(const Vector3f& P, const Vector3f& I, const uint32_t& index, const Vector2f& uv,
+                              Vector3f& N, Vector2f& st) const override;
+    Vector3f evalDiffuseColor(const Vector2f&) const override;
+    Bounds3 getBounds() override { return bounds; }
+    float getArea() override { return area; }
+    void Sample(Intersection& pos, float& pdf, const Vector2f& u) override;
+    bool hasEmit() override;
+};
+
+// Many spheres sharing one material (e.g. particles), stored structure-of-arrays and
+// intersected eight at a time instead of through one virtual Sphere call per particle.
+// Spheres are packed in the order given, so spatially coherent input gives tighter packets.
+// The material is not owned. The packets point back at the set, so it can't be copied or moved.
+class SphereSet : public Object
+{
+public:
+    SphereSet(const std::vector<Vector3f>& c, const std::vector<float>& r, Material* mt)
+        : centers(c), radii(r), m(mt)
+    {
+        uint32_t n = centers.size();
+        for (uint32_t first = 0; first < n; first += SpherePacket::Width)
+            packets.emplace_back(this, first, std::min<uint32_t>(SpherePacket::Width, n - first));
+
+        area = 0;
+        std::vector<Object*> ptrs;
+        for (auto& p : packets) {
+            ptrs.push_back(&p);
+            bounding_box = Union(bounding_box, p.bounds);
+            area += p.area;
+        }
+        bvh = std::make_unique<BVHAccel>(ptrs);
+    }
+
+    SphereSet(const SphereSet&) = delete;
+    SphereSet(SphereSet&&) = delete;
+    SphereSet& operator=(const SphereSet&) = delete;
+    SphereSet& operator=(SphereSet&&) = delete;
+
+    bool intersect(const Ray& ray) override { return getIntersection(ray).happened; }
+
+    bool intersect(const Ray& ray, float& tnear, uint32_t& index) const override
+    {
+        bool hit = false;
+        for (const auto& p : packets) {
+            float t;
+            uint32_t id;
+            if (intersectSpherePacket(p.packet, ray.origin, ray.direction, 0, tnear, t, id)) {
+                tnear = t;
+                index = id;
+                hit = true;
+            }
+        }
+        return hit;
+    }
+
+    Intersection getIntersection(Ray ray) override
+    {
+        Intersection intersec;
+        if (bvh)
+            intersec = bvh->Intersect(ray);
+        return intersec;
+    }
+
+    void getSurfaceProperties(const Vector3f& P, const Vector3f&, const uint32_t& index, const Vector2f&,
+                              Vector3f& N, Vector2f&) const override
+    {
+        N = normalize(P - centers[index]);
+    }
+
+    Vector3f evalDiffuseColor(const Vector2f&) const override { return m->Kd; }
+    Bounds3 getBounds() override { return bounding_box; }
+    float getArea() override { return area; }
+
+    void Sample(Intersection& pos, float& pdf, const Vector2f& u) override
+    {
+        bvh->Sample(pos, pdf, u);
+        pos.emit = m->getEmission();
+    }
+
+    bool hasEmit() override { return m->hasEmission(); }
+
+    std::vector<Vector3f> centers;
+    std::vector<float> radii;
+    std::vector<SpherePacketObject> packets;
+    Bounds3 bounding_box;
+    std::unique_ptr<BVHAccel> bvh;
+    float area;
+    Material* m;
+};
+
+inline SpherePacketObject::SpherePacketObject(const SphereSet* s, uint32_t f, uint32_t n)
+    : set(s), first(f), count(n), area(0)
+{
+    for (int i = 0; i < SpherePacket::Width; ++i) {
+        // unused lanes repeat the last sphere of the packet
+        uint32_t id = first + std::min<uint32_t>(i, count - 1);
+        const Vector3f& c = set->centers[id];
+        float r = set->radii[id];
+        packet.cx[i] = c.x;
+        packet.cy[i] = c.y;
+        packet.cz[i] = c.z;
+        packet.radius2[i] = r * r;
+        packet.id[i] = id;
+        if ((uint32_t)i < count) {
+            bounds = Union(bounds, Bounds3(c - Vector3f(r), c + Vector3f(r)));
+            area += 4 * M_PI * r * r;
+        }
+    }
+}
+
+inline bool SpherePacketObject::intersect(const Ray& ray)
+{
+    float t;
+    uint32_t id;
+    return intersectSpherePacket(packet, ray.origin, ray.direction, 0, kInfinity, t, id);
+}
+
+inline bool SpherePacketObject::intersect(const Ray& ray, float& tnear, uint32_t& index) const
+{
+    return intersectSpherePacket(packet, ray.origin, ray.direction, 0, tnear, tnear, index);
+}
+
+inline Intersection SpherePacketObject::getIntersection(Ray ray)
+{
+    Intersection inter;
+    float t;
+    uint32_t id;
+    if (!intersectSpherePacket(packet, ray.origin, ray.direction, 0, kInfinity, t, id))
+        return inter;
+
+    inter.happened = true;
+    inter.coords = ray(t);
+    inter.normal = normalize(inter.coords - set->centers[id]);
+    inter.m = set->m;
+    inter.obj = this;
+    inter.distance = t;
+    inter.emit = set->m->getEmission();
+    return inter;
+}
+
+inline void SpherePacketObject::getSurfaceProperties(const Vector3f& P, const Vector3f& I, const uint32_t& index,
+                                                     const Vector2f& uv, Vector3f& N, Vector2f& st) const
+{
+    set->getSurfaceProperties(P, I, index, uv, N, st);
+}
+
+inline Vector3f SpherePacketObject::evalDiffuseColor(const Vector2f& st) const
+{
+    return set->evalDiffuseColor(st);
+}
+
+inline void SpherePacketObject::Sample(Intersection& pos, float& pdf, const Vector2f& u)
+{
+    // pick a sphere proportionally to its area with u.x, rescale u.x, then a uniform point on it
+    float p = u.x * area, sphereArea = 0;
+    uint32_t id = first;
+    for (uint32_t i = 0; i < count; ++i) {
+        id = first + i;
+        sphereArea = 4 * M_PI * set->radii[id] * set->radii[id];
+        if (p < sphereArea || i + 1 == count)
+            break;
+        p -= sphereArea;
+    }
+    float ux = std::min(std::max(p / sphereArea, 0.0f), 0x1.fffffep-1f);
+    float z = 1 - 2 * ux, phi = 2 * M_PI * u.y;
+    float r = std::sqrt(std::max(0.f, 1 - z * z));
+    Vector3f dir(r * std::cos(phi), r * std::sin(phi), z);
+    pos.coords = set->centers[id] + set->radii[id] * dir;
+    pos.normal = dir;
+    pos.emit = set->m->getEmission();
+    pdf = 1.0f / area;
+}
+
+inline bool SpherePacketObject::hasEmit()
+{
+    return set->m->hasEmission();
+}
+
+#endif //RAYTRACING_SPHERESET_H
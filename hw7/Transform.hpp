@@ -0,0 +1,141 @@
+#ifndef RAYTRACING_TRANSFORM_H
+#define RAYTRACING_TRANSFORM_H
+
+#include "Vector.hpp"
+#include "global.hpp"
+
+#include <vector>
+
+// Affine transform p' = M p + t, with M stored row by row. Compose with *, where (a * b) applies
+// b first, the same order as matrix products.
+struct Transform
+{
+    float m[3][3] = {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    Vector3f t;
+
+    static Transform Translate(const Vector3f& d)
+    {
+        Transform r;
+        r.t = d;
+        return r;
+    }
+
+    static Transform Scale(const Vector3f& s)
+    {
+        Transform r;
+        r.m[0][0] = s.x;
+        r.m[1][1] = s.y;
+        r.m[2][2] = s.z;
+        return r;
+    }
+
+    // rotation by angle degrees about axis (Rodrigues' formula)
+    static Transform Rotate(const Vector3f& axis, float angle)
+    {
+        Vector3f a = normalize(axis);
+        float theta = angle * M_PI / 180.0f;
+        float s = std::sin(theta), c = std::cos(theta), k = 1 - c;
+        Transform r;
+        r.m[0][0] = a.x * a.x * k + c;       r.m[0][1] = a.x * a.y * k - a.z * s; r.m[0][2] = a.x * a.z * k + a.y * s;
+        r.m[1][0] = a.y * a.x * k + a.z * s; r.m[1][1] = a.y * a.y * k + c;       r.m[1][2] = a.y * a.z * k - a.x * s;
+        r.m[2][0] = a.z * a.x * k - a.y * s; r.m[2][1] = a.z * a.y * k + a.x * s; r.m[2][2] = a.z * a.z * k + c;
+        return r;
+    }
+
+    Transform operator*(const Transform& b) const
+    {
+        Transform r;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j)
+                r.m[i][j] = m[i][0] * b.m[0][j] + m[i][1] * b.m[1][j] + m[i][2] * b.m[2][j];
+        r.t = applyLinear(b.t) + t;
+        return r;
+    }
+
+    Transform inverse() const
+    {
+        Transform r;
+        float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        float invDet = 1 / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+        r.m[0][0] = c00 * invDet;
+        r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+        r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+        r.m[1][0] = c01 * invDet;
+        r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+        r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+        r.m[2][0] = c02 * invDet;
+        r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+        r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+        r.t = -r.applyLinear(t);
+        return r;
+    }
+
+    Vector3f point(const Vector3f& p) const { return applyLinear(p) + t; }
+    Vector3f vector(const Vector3f& v) const { return applyLinear(v); }
+    // call on the inverse of the transform that moves the points: normals go by M^-T
+    Vector3f normal(const Vector3f& n) const
+    {
+        return Vector3f(m[0][0] * n.x + m[1][0] * n.y + m[2][0] * n.z,
+                        m[0][1] * n.x + m[1][1] * n.y + m[2][1] * n.z,
+                        m[0][2] * n.x + m[1][2] * n.y + m[2][2] * n.z);
+    }
+
+private:
+    Vector3f applyLinear(const Vector3f& v) const
+    {
+        return Vector3f(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                        m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                        m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+};
+
+// Transform that changes over the frame time t in [0,1]: a list of translate / rotate / scale
+// steps, each with a start and an end parameter that are interpolated linearly, composed like
+// Transform (later steps apply after earlier ones). Interpolating the parameters rather than the
+// matrices keeps rotations rigid.
+struct AnimatedTransform
+{
+    enum class Kind { Translate, Rotate, Scale };
+    struct Step
+    {
+        Kind kind;
+        Vector3f start, end;  // offset / scale, or the angle in degrees in x for Rotate
+        Vector3f axis;
+    };
+
+    void translate(const Vector3f& start, const Vector3f& end) { steps.push_back({Kind::Translate, start, end, Vector3f(0.0f)}); }
+    void scale(const Vector3f& start, const Vector3f& end) { steps.push_back({Kind::Scale, start, end, Vector3f(0.0f)}); }
+    void rotate(const Vector3f& axis, float start, float end)
+    {
+        steps.push_back({Kind::Rotate, Vector3f(start), Vector3f(end), axis});
+    }
+
+    bool isAnimated() const
+    {
+        for (auto& s : steps)
+            if (s.start.x != s.end.x || s.start.y != s.end.y || s.start.z != s.end.z)
+                return true;
+        return false;
+    }
+
+    Transform at(float time) const
+    {
+        Transform r;
+        for (auto& s : steps) {
+            Vector3f v = lerp(s.start, s.end, time);
+            if (s.kind == Kind::Translate)
+                r = Transform::Translate(v) * r;
+            else if (s.kind == Kind::Scale)
+                r = Transform::Scale(v) * r;
+            else
+                r = Transform::Rotate(s.axis, v.x) * r;
+        }
+        return r;
+    }
+
+    std::vector<Step> steps;
+};
+
+#endif //RAYTRACING_TRANSFORM_H
@@ -5,11 +5,12 @@
 #include "Material.hpp"
 #include "OBJ_Loader.hpp"
 #include "Object.hpp"
-#include "Triangle.hpp"
+#include "Transform.hpp"
 #include <cassert>
 #include <array>
+#include <stdexcept>
 
-bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1,
+inline bool rayTriangleIntersect(const Vector3f& v0, const Vector3f& v1,
                           const Vector3f& v2, const Vector3f& orig,
                           const Vector3f& dir, float& tnear, float& u, float& v)
 {
@@ -72,8 +73,8 @@ public:
     }
     Vector3f evalDiffuseColor(const Vector2f&) const override;
     Bounds3 getBounds() override;
-    void Sample(Intersection &pos, float &pdf){
-        float x = std::sqrt(get_random_float()), y = get_random_float();
+    void Sample(Intersection &pos, float &pdf, const Vector2f &u){
+        float x = std::sqrt(u.x), y = u.y;
         pos.coords = v0 * (1.0f - x) + v1 * (x * (1.0f - y)) + v2 * (x * y);
         pos.normal = this->normal;
         pdf = 1.0f / area;
@@ -89,14 +90,18 @@ public:
 class MeshTriangle : public Object
 {
 public:
-    MeshTriangle(const std::string& filename, Material *mt = new Material())
+    // toWorld places the mesh's vertices in the scene; mt is not owned (scene materials live in
+    // Scene::arena)
+    MeshTriangle(const std::string& filename, Material *mt, const Transform& toWorld = Transform())
     {
         objl::Loader loader;
-        loader.LoadFile(filename);
+        if (!loader.LoadFile(filename) || loader.LoadedMeshes.size() != 1)
+            throw std::runtime_error("expected one mesh in " + filename);
         area = 0;
         m = mt;
-        assert(loader.LoadedMeshes.size() == 1);
         auto mesh = loader.LoadedMeshes[0];
+        if (mesh.Vertices.empty())
+            throw std::runtime_error("no triangles in " + filename);
 
         Vector3f min_vert = Vector3f{std::numeric_limits<float>::infinity(),
                                      std::numeric_limits<float>::infinity(),
@@ -104,13 +109,15 @@ public:
         Vector3f max_vert = Vector3f{-std::numeric_limits<float>::infinity(),
                                      -std::numeric_limits<float>::infinity(),
                                      -std::numeric_limits<float>::infinity()};
+        triangleCount = mesh.Vertices.size() / 3;
+        triangles = arena.AllocArray<Triangle>(triangleCount);
         for (int i = 0; i < mesh.Vertices.size(); i += 3) {
             std::array<Vector3f, 3> face_vertices;
 
             for (int j = 0; j < 3; j++) {
-                auto vert = Vector3f(mesh.Vertices[i + j].Position.X,
-                                     mesh.Vertices[i + j].Position.Y,
-                                     mesh.Vertices[i + j].Position.Z);
+                auto vert = toWorld.point(Vector3f(mesh.Vertices[i + j].Position.X,
+                                                   mesh.Vertices[i + j].Position.Y,
+                                                   mesh.Vertices[i + j].Position.Z));
                 face_vertices[j] = vert;
 
                 min_vert = Vector3f(std::min(min_vert.x, vert.x),
@@ -121,18 +128,18 @@ public:
                                     std::max(max_vert.z, vert.z));
             }
 
-            triangles.emplace_back(face_vertices[0], face_vertices[1],
-                                   face_vertices[2], mt);
+            new (&triangles[i / 3]) Triangle(face_vertices[0], face_vertices[1],
+                                             face_vertices[2], mt);
         }
 
         bounding_box = Bounds3(min_vert, max_vert);
 
         std::vector<Object*> ptrs;
-        for (auto& tri : triangles){
-            ptrs.push_back(&tri);
-            area += tri.area;
+        for (uint32_t k = 0; k < triangleCount; ++k){
+            ptrs.push_back(&triangles[k]);
+            area += triangles[k].area;
         }
-        bvh = new BVHAccel(ptrs);
+        bvh = std::make_unique<BVHAccel>(ptrs);
     }
 
     bool intersect(const Ray& ray) { return true; }
@@ -195,8 +202,8 @@ public:
         return intersec;
     }
     
-    void Sample(Intersection &pos, float &pdf){
-        bvh->Sample(pos, pdf);
+    void Sample(Intersection &pos, float &pdf, const Vector2f &u){
+        bvh->Sample(pos, pdf, u);
         pos.emit = m->getEmission();
     }
     float getArea(){
@@ -212,9 +219,12 @@ public:
     std::unique_ptr<uint32_t[]> vertexIndex;
     std::unique_ptr<Vector2f[]> stCoordinates;
 
-    std::vector<Triangle> triangles;
+    // the triangles live in arena, in file order
+    MemoryArena arena;
+    Triangle* triangles = nullptr;
+    uint32_t triangleCount = 0;
 
-    BVHAccel* bvh;
+    std::unique_ptr<BVHAccel> bvh;
     float area;
 
     Material* m;
@@ -229,42 +239,67 @@ inline bool Triangle::intersect(const Ray& ray, float& tnear,
 
 inline Bounds3 Triangle::getBounds() { return Union(Bounds3(v0, v1), v2); }
 
+// Watertight ray/triangle test (Woop, Benthin and Wald, JCGT 2013), all in float: the vertices
+// are moved into a space where the ray starts at the origin and runs along +z, so the edge
+// functions are evaluated on the same rounded values for both triangles sharing an edge and no
+// ray slips through. Hits closer than the rounding error bound of t are rejected, which keeps
+// rays leaving a surface from hitting it again.
 inline Intersection Triangle::getIntersection(Ray ray)
 {
     Intersection inter;
 
-    if (dotProduct(ray.direction, normal) > 0)
-        return inter;
-    double u, v, t_tmp = 0;
-    // pevc == s1
-    Vector3f pvec = crossProduct(ray.direction, e2);
-    double det = dotProduct(e1, pvec);
-    if (fabs(det) < EPSILON)
+    if (dotProduct(ray.direction, normal) > 0 && !(m && m->isTwoSided()))
         return inter;
 
-    double det_inv = 1. / det;
-    // tvec == s
-    Vector3f tvec = ray.origin - v0;
-    u = dotProduct(tvec, pvec) * det_inv;
-    if (u < 0 || u > 1)
-        return inter;
-    // qvec == s2
-    Vector3f qvec = crossProduct(tvec, e1);
-    v = dotProduct(ray.direction, qvec) * det_inv;
-    if (v < 0 || u + v > 1)
+    // the largest direction component becomes z
+    const Vector3f& d = ray.direction;
+    float ax = std::fabs(d.x), ay = std::fabs(d.y), az = std::fabs(d.z);
+    int kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+    int kx = kz == 2 ? 0 : kz + 1, ky = kx == 2 ? 0 : kx + 1;
+    Vector3f dp(d[kx], d[ky], d[kz]);
+    float Sx = -dp.x / dp.z, Sy = -dp.y / dp.z, Sz = 1.f / dp.z;
+
+    Vector3f a = v0 - ray.origin, b = v1 - ray.origin, c = v2 - ray.origin;
+    Vector3f p0(a[kx], a[ky], a[kz]), p1(b[kx], b[ky], b[kz]), p2(c[kx], c[ky], c[kz]);
+    p0.x += Sx * p0.z; p0.y += Sy * p0.z;
+    p1.x += Sx * p1.z; p1.y += Sy * p1.z;
+    p2.x += Sx * p2.z; p2.y += Sy * p2.z;
+
+    float e0 = p1.x * p2.y - p1.y * p2.x;
+    float e1 = p2.x * p0.y - p2.y * p0.x;
+    float e2 = p0.x * p1.y - p0.y * p1.x;
+    if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0))
         return inter;
-    t_tmp = dotProduct(e2, qvec) * det_inv;
-    if (t_tmp < 0) 
+    float det = e0 + e1 + e2;
+    if (det == 0)
         return inter;
 
-    // TODO find ray triangle intersection
+    p0.z *= Sz; p1.z *= Sz; p2.z *= Sz;
+    float tScaled = e0 * p0.z + e1 * p1.z + e2 * p2.z;
+    if ((det < 0 && tScaled >= 0) || (det > 0 && tScaled <= 0))
+        return inter;
+    float invDet = 1 / det;
+    float t = tScaled * invDet;
+
+    // conservative bound on the error of t (pbrt-v3, 3.9.6)
+    float maxZ = std::max({std::fabs(p0.z), std::fabs(p1.z), std::fabs(p2.z)});
+    float maxX = std::max({std::fabs(p0.x), std::fabs(p1.x), std::fabs(p2.x)});
+    float maxY = std::max({std::fabs(p0.y), std::fabs(p1.y), std::fabs(p2.y)});
+    float deltaZ = roundingGamma(3) * maxZ;
+    float deltaX = roundingGamma(5) * (maxX + maxZ), deltaY = roundingGamma(5) * (maxY + maxZ);
+    float deltaE = 2 * (roundingGamma(2) * maxX * maxY + deltaY * maxX + deltaX * maxY);
+    float maxE = std::max({std::fabs(e0), std::fabs(e1), std::fabs(e2)});
+    float deltaT = 3 * (roundingGamma(3) * maxE * maxZ + deltaE * maxZ + deltaZ * maxE) * std::fabs(invDet);
+    if (t <= deltaT)
+        return inter;
 
-    inter.coords = ray.origin + t_tmp * ray.direction;
+    // the barycentric point is more accurate than origin + t * dir
+    inter.coords = v0 * (e0 * invDet) + v1 * (e1 * invDet) + v2 * (e2 * invDet);
     inter.happened = true;
     inter.m = this->m;
     inter.normal = this->normal;
     inter.obj = this;
-    inter.distance = t_tmp;
+    inter.distance = t;
     inter.emit = this->m->getEmission();
 
     return inter;
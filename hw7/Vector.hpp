@@ -9,6 +9,101 @@
 #include <cmath>
 #include <algorithm>
 
+// With RAYTRACING_SIMD defined (the CMake option of the same name), Vector3f is stored in a
+// 16-byte aligned 4-float register (x, y, z, and a padding lane kept at 0 for finite operands;
+// div clears it, as it would be 0 / 0) and its arithmetic compiles to packed SSE / NEON
+// instructions. Without it, or on other targets, it is three plain floats. The API and the x/y/z
+// members are the same either way, and every lane rounds like the scalar code.
+#if defined(RAYTRACING_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define RAYTRACING_VECTOR_SSE
+#elif defined(RAYTRACING_SIMD) && defined(__aarch64__)
+#include <arm_neon.h>
+#define RAYTRACING_VECTOR_NEON
+#endif
+
+#if defined(RAYTRACING_VECTOR_SSE) || defined(RAYTRACING_VECTOR_NEON)
+#define RAYTRACING_VECTOR_SIMD
+
+namespace simd {
+#ifdef RAYTRACING_VECTOR_SSE
+using float4 = __m128;
+inline float4 set(float x, float y, float z) { return _mm_set_ps(0, z, y, x); }
+inline float4 add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 div(float4 a, float4 b) { return _mm_and_ps(_mm_div_ps(a, b), _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1))); }
+inline float4 min(float4 a, float4 b) { return _mm_min_ps(a, b); }
+inline float4 max(float4 a, float4 b) { return _mm_max_ps(a, b); }
+inline float4 splat(float v) { return _mm_set1_ps(v); }
+// x + y + z
+inline float sum3(float4 v)
+{
+    __m128 yzw = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 2, 1));
+    __m128 zzz = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+    return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(v, yzw), zzz));
+}
+// (y, z, x, w)
+inline float4 yzx(float4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)); }
+#else
+using float4 = float32x4_t;
+inline float4 set(float x, float y, float z)
+{
+    float v[4] = {x, y, z, 0};
+    return vld1q_f32(v);
+}
+inline float4 add(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline float4 div(float4 a, float4 b) { return vsetq_lane_f32(0.0f, vdivq_f32(a, b), 3); }
+inline float4 min(float4 a, float4 b) { return vminq_f32(a, b); }
+inline float4 max(float4 a, float4 b) { return vmaxq_f32(a, b); }
+inline float4 splat(float v) { return vdupq_n_f32(v); }
+inline float sum3(float4 v) { return vgetq_lane_f32(v, 0) + vgetq_lane_f32(v, 1) + vgetq_lane_f32(v, 2); }
+inline float4 yzx(float4 v)
+{
+    float4 zwxy = vextq_f32(v, v, 2);
+    float4 r = vextq_f32(v, v, 1);  // (y, z, w, x)
+    return vcopyq_laneq_f32(r, 2, zwxy, 2);
+}
+#endif
+}
+
+class alignas(16) Vector3f {
+public:
+    union {
+        struct { float x, y, z; };
+        simd::float4 m;
+    };
+    Vector3f() : m(simd::set(0, 0, 0)) {}
+    Vector3f(float xx) : m(simd::set(xx, xx, xx)) {}
+    Vector3f(float xx, float yy, float zz) : m(simd::set(xx, yy, zz)) {}
+    explicit Vector3f(simd::float4 v) : m(v) {}
+    Vector3f(const Vector3f &v) : m(v.m) {}
+    Vector3f& operator = (const Vector3f &v) { m = v.m; return *this; }
+    Vector3f operator * (const float &r) const { return Vector3f(simd::mul(m, simd::splat(r))); }
+    Vector3f operator / (const float &r) const { return Vector3f(simd::div(m, simd::splat(r))); }
+
+    float norm() const { return std::sqrt(simd::sum3(simd::mul(m, m))); }
+    Vector3f normalized() const { return *this / norm(); }
+
+    Vector3f operator * (const Vector3f &v) const { return Vector3f(simd::mul(m, v.m)); }
+    Vector3f operator / (const Vector3f &v) const { return Vector3f(simd::div(m, v.m)); }
+    Vector3f operator - (const Vector3f &v) const { return Vector3f(simd::sub(m, v.m)); }
+    Vector3f operator + (const Vector3f &v) const { return Vector3f(simd::add(m, v.m)); }
+    Vector3f operator - () const { return Vector3f(simd::sub(simd::set(0, 0, 0), m)); }
+    Vector3f& operator += (const Vector3f &v) { m = simd::add(m, v.m); return *this; }
+    friend Vector3f operator * (const float &r, const Vector3f &v)
+    { return Vector3f(simd::mul(v.m, simd::splat(r))); }
+    friend std::ostream & operator << (std::ostream &os, const Vector3f &v)
+    { return os << v.x << ", " << v.y << ", " << v.z; }
+    float        operator[](int index) const;
+    float&       operator[](int index);
+
+    static Vector3f Min(const Vector3f &p1, const Vector3f &p2) { return Vector3f(simd::min(p1.m, p2.m)); }
+    static Vector3f Max(const Vector3f &p1, const Vector3f &p2) { return Vector3f(simd::max(p1.m, p2.m)); }
+};
+#else
 class Vector3f {
 public:
     float x, y, z;
@@ -18,13 +113,14 @@ public:
     Vector3f operator * (const float &r) const { return Vector3f(x * r, y * r, z * r); }
     Vector3f operator / (const float &r) const { return Vector3f(x / r, y / r, z / r); }
 
-    float norm() {return std::sqrt(x * x + y * y + z * z);}
-    Vector3f normalized() {
+    float norm() const {return std::sqrt(x * x + y * y + z * z);}
+    Vector3f normalized() const {
         float n = std::sqrt(x * x + y * y + z * z);
         return Vector3f(x / n, y / n, z / n);
     }
 
     Vector3f operator * (const Vector3f &v) const { return Vector3f(x * v.x, y * v.y, z * v.z); }
+    Vector3f operator / (const Vector3f &v) const { return Vector3f(x / v.x, y / v.y, z / v.z); }
     Vector3f operator - (const Vector3f &v) const { return Vector3f(x - v.x, y - v.y, z - v.z); }
     Vector3f operator + (const Vector3f &v) const { return Vector3f(x + v.x, y + v.y, z + v.z); }
     Vector3f operator - () const { return Vector3f(-x, -y, -z); }
@@ -33,8 +129,8 @@ public:
     { return Vector3f(v.x * r, v.y * r, v.z * r); }
     friend std::ostream & operator << (std::ostream &os, const Vector3f &v)
     { return os << v.x << ", " << v.y << ", " << v.z; }
-    double       operator[](int index) const;
-    double&      operator[](int index);
+    float        operator[](int index) const;
+    float&       operator[](int index);
 
 
     static Vector3f Min(const Vector3f &p1, const Vector3f &p2) {
@@ -47,7 +143,11 @@ public:
                        std::max(p1.z, p2.z));
     }
 };
-inline double Vector3f::operator[](int index) const {
+#endif
+inline float Vector3f::operator[](int index) const {
+    return (&x)[index];
+}
+inline float& Vector3f::operator[](int index) {
     return (&x)[index];
 }
 
@@ -66,27 +166,39 @@ public:
 inline Vector3f lerp(const Vector3f &a, const Vector3f& b, const float &t)
 { return a * (1 - t) + b * t; }
 
+inline float dotProduct(const Vector3f &a, const Vector3f &b)
+{
+#ifdef RAYTRACING_VECTOR_SIMD
+    return simd::sum3(simd::mul(a.m, b.m));
+#else
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+#endif
+}
+
 inline Vector3f normalize(const Vector3f &v)
 {
-    float mag2 = v.x * v.x + v.y * v.y + v.z * v.z;
+    float mag2 = dotProduct(v, v);
     if (mag2 > 0) {
         float invMag = 1 / sqrtf(mag2);
-        return Vector3f(v.x * invMag, v.y * invMag, v.z * invMag);
+        return v * invMag;
     }
 
     return v;
 }
 
-inline float dotProduct(const Vector3f &a, const Vector3f &b)
-{ return a.x * b.x + a.y * b.y + a.z * b.z; }
-
 inline Vector3f crossProduct(const Vector3f &a, const Vector3f &b)
 {
+#ifdef RAYTRACING_VECTOR_SIMD
+    // a x b = (a * b.yzx - a.yzx * b).yzx
+    simd::float4 c = simd::sub(simd::mul(a.m, simd::yzx(b.m)), simd::mul(simd::yzx(a.m), b.m));
+    return Vector3f(simd::yzx(c));
+#else
     return Vector3f(
             a.y * b.z - a.z * b.y,
             a.z * b.x - a.x * b.z,
             a.x * b.y - a.y * b.x
     );
+#endif
 }
 
 
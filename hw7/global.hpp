@@ -1,6 +1,7 @@
 #pragma once
 #include <iostream>
 #include <cmath>
+#include <limits>
 #include <random>
 
 #undef M_PI
@@ -9,6 +10,12 @@
 extern const float  EPSILON;
 const float kInfinity = std::numeric_limits<float>::max();
 
+// bound on the relative rounding error of n float operations (Higham; pbrt's gamma(n))
+constexpr float roundingGamma(int n)
+{
+    return (n * std::numeric_limits<float>::epsilon() * 0.5f) / (1 - n * std::numeric_limits<float>::epsilon() * 0.5f);
+}
+
 inline float clamp(const float &lo, const float &hi, const float &v)
 { return std::max(lo, std::min(hi, v)); }
 
@@ -16,11 +23,11 @@ inline  bool solveQuadratic(const float &a, const float &b, const float &c, floa
 {
     float discr = b * b - 4 * a * c;
     if (discr < 0) return false;
-    else if (discr == 0) x0 = x1 = - 0.5 * b / a;
+    else if (discr == 0) x0 = x1 = - 0.5f * b / a;
     else {
         float q = (b > 0) ?
-                  -0.5 * (b + sqrt(discr)) :
-                  -0.5 * (b - sqrt(discr));
+                  -0.5f * (b + std::sqrt(discr)) :
+                  -0.5f * (b - std::sqrt(discr));
         x0 = q / a;
         x1 = c / q;
     }
@@ -1,50 +1,69 @@
 #include "Renderer.hpp"
 #include "Scene.hpp"
-#include "Triangle.hpp"
-#include "Sphere.hpp"
+#include "RenderServer.hpp"
+#include "SceneLoader.hpp"
 #include "Vector.hpp"
 #include "global.hpp"
+#include <cerrno>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
 
-// In the main function of the program, we create the scene (create objects and
-// lights) as well as set the options for the render (image width and height,
-// maximum recursion depth, field-of-view, etc.). We then call the render
-// function().
+// The scene (objects, materials, lights, camera and render settings) is read from the XML file
+// given as the first argument, scenes/cornellbox.xml by default; see SceneLoader.hpp for the
+// format. We then call the render function(). With --serve the scene stays loaded and render
+// requests are read from stdin instead; see RenderServer.hpp.
 int main(int argc, char** argv)
 {
+    std::string path = "../scenes/cornellbox.xml";
+    bool serve = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--serve")
+            serve = true;
+        else
+            path = argv[i];
+    }
 
-    // Change the definition here to change resolution
-    Scene scene(784, 784);
-
-    Material* red = new Material(DIFFUSE, Vector3f(0.0f));
-    red->Kd = Vector3f(0.63f, 0.065f, 0.05f);
-    Material* green = new Material(DIFFUSE, Vector3f(0.0f));
-    green->Kd = Vector3f(0.14f, 0.45f, 0.091f);
-    Material* white = new Material(DIFFUSE, Vector3f(0.0f));
-    white->Kd = Vector3f(0.725f, 0.71f, 0.68f);
-    Material* light = new Material(DIFFUSE, (8.0f * Vector3f(0.747f+0.058f, 0.747f+0.258f, 0.747f) + 15.6f * Vector3f(0.740f+0.287f,0.740f+0.160f,0.740f) + 18.4f *Vector3f(0.737f+0.642f,0.737f+0.159f,0.737f)));
-    light->Kd = Vector3f(0.65f);
-
-    MeshTriangle floor("../models/cornellbox/floor.obj", white);
-    MeshTriangle shortbox("../models/cornellbox/shortbox.obj", white);
-    MeshTriangle tallbox("../models/cornellbox/tallbox.obj", white);
-    MeshTriangle left("../models/cornellbox/left.obj", red);
-    MeshTriangle right("../models/cornellbox/right.obj", green);
-    MeshTriangle light_("../models/cornellbox/light.obj", light);
-
-    scene.Add(&floor);
-    scene.Add(&shortbox);
-    scene.Add(&tallbox);
-    scene.Add(&left);
-    scene.Add(&right);
-    scene.Add(&light_);
+    // in server mode the replies own stdout; progress bars and build logs (printf ones included)
+    // go to stderr
+    FILE* replies = nullptr;
+    if (serve) {
+        int fd = dup(STDOUT_FILENO);
+        if (fd < 0 || !(replies = fdopen(fd, "w")) || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            std::cerr << "cannot redirect stdout for --serve: " << std::strerror(errno) << "\n";
+            return 1;
+        }
+    }
+
+    SceneDescription description;
+    try {
+        description = loadScene(path);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    Scene& scene = *description.scene;
+    const Camera& camera = *description.camera;
 
     scene.buildBVH();
 
+    if (serve) {
+        RenderServer server(std::move(description));
+        server.Run(std::cin, replies);
+        std::fclose(replies);
+        return 0;
+    }
+
     Renderer r;
 
     auto start = std::chrono::system_clock::now();
-    r.Render(scene);
+    try {
+        r.Render(scene, camera);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
     auto stop = std::chrono::system_clock::now();
 
     std::cout << "Render complete: \n";